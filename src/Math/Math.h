@@ -61,4 +61,18 @@ T distFromLine(const Vec2<T>& point, const Vec2<T>& linePoint, const Vec2<T>& li
 	return (point - linePoint).dot(lineNormal.getUnit());
 }
 
+template<typename T>
+Vec2<T> closestPointOnSegment(const Vec2<T>& point, const Vec2<T>& p0, const Vec2<T>& p1)
+{
+	Vec2<T> dir = p1 - p0;
+	T lengthSquared = dir.dot(dir);
+
+	if(lengthSquared <= 0.0)
+		return p0;
+
+	T t = (point - p0).dot(dir) / lengthSquared;
+	t = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+	return p0 + dir * t;
+}
+
 #endif
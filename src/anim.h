@@ -0,0 +1,132 @@
+#ifndef ANIM_H
+#define ANIM_H
+
+#include "map.h"
+#include "pvs.h"
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+namespace anim
+{
+	// Sectors whose heights changed since the last clear_dirty. The flags keep
+	// every index listed once, and clearing only touches what was listed.
+	struct dirtyset
+	{
+		std::vector<uint8_t> sectorFlags;
+		std::vector<int> sectors;
+	};
+
+	inline void init_dirty(const map::level& level, dirtyset& dirty)
+	{
+		dirty.sectorFlags.assign(level.sectors.size(), 0);
+		dirty.sectors.clear();
+	}
+
+	inline void mark_sector(dirtyset& dirty, int sectorId)
+	{
+		if(dirty.sectorFlags[sectorId])
+			return;
+		dirty.sectorFlags[sectorId] = 1;
+		dirty.sectors.push_back(sectorId);
+	}
+
+	inline void clear_dirty(dirtyset& dirty)
+	{
+		for(int s : dirty.sectors)
+			dirty.sectorFlags[s] = 0;
+		dirty.sectors.clear();
+	}
+
+	// Height of the tallest thing standing in each sector, from its bottom
+	// to its top. Crushers do not come down on anything this tall.
+	inline void build_occupant_heights(const map::level& level, const pvs::sectorthings& things,
+		std::vector<float>& out)
+	{
+		out.assign(level.sectors.size(), 0.0f);
+		for(int s = 0; s < (int)level.sectors.size(); s++)
+		{
+			for(int i = things.start[s]; i < things.start[s + 1]; i++)
+			{
+				const auto& t = level.things[things.thingIds[i]];
+				out[s] = std::max(out[s], t.top - t.bottom);
+			}
+		}
+	}
+
+	// Doors and crushers move the ceiling, lifts move the floor. Every mover
+	// travels between low and high and rests wait seconds at each end. A
+	// crusher going down turns back up as soon as its ceiling would come
+	// closer to the floor than the occupant height of its sector.
+	inline void tick_movers(map::level& level, const std::vector<float>& occupantHeights, float dt, dirtyset& dirty)
+	{
+		for(auto& m : level.movers)
+		{
+			if(m.timer > 0.0f)
+			{
+				m.timer -= dt;
+				continue;
+			}
+
+			auto& sector = level.sectors[m.sectorId];
+			float& height = m.type == map::mover::kind::LIFT ? sector.floorHeight : sector.ceilingHeight;
+
+			const float crushLimit = sector.floorHeight + occupantHeights[m.sectorId];
+
+			float next = height + m.direction * m.speed * dt;
+			if(m.type == map::mover::kind::CRUSHER && m.direction < 0 && next < crushLimit)
+			{
+				next = std::min(height, crushLimit);
+				m.direction = 1;
+			}
+			else if(next >= m.high)
+			{
+				next = m.high;
+				m.direction = -1;
+				m.timer = m.wait;
+			}
+			else if(next <= m.low)
+			{
+				next = m.low;
+				m.direction = 1;
+				m.timer = m.wait;
+			}
+
+			if(next != height)
+			{
+				height = next;
+				mark_sector(dirty, m.sectorId);
+			}
+		}
+	}
+
+	// Scrolled sides are read straight from the level when drawn, so they
+	// are not tracked as dirty.
+	inline void tick_scrollers(map::level& level, float dt)
+	{
+		for(const auto& sc : level.scrollers)
+		{
+			auto& texCoord = level.sides[sc.sideId].texCoord;
+			texCoord.left += sc.du * dt;
+			texCoord.right += sc.du * dt;
+			texCoord.bottom += sc.dv * dt;
+			texCoord.top += sc.dv * dt;
+
+			const float uTurns = std::floor(texCoord.left);
+			const float vTurns = std::floor(texCoord.bottom);
+			texCoord.left -= uTurns;
+			texCoord.right -= uTurns;
+			texCoord.bottom -= vTurns;
+			texCoord.top -= vTurns;
+		}
+	}
+
+	inline void tick(map::level& level, const std::vector<float>& occupantHeights, float dt, dirtyset& dirty)
+	{
+		tick_movers(level, occupantHeights, dt, dirty);
+		tick_scrollers(level, dt);
+	}
+}
+
+#endif
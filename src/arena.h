@@ -0,0 +1,158 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+namespace arena
+{
+	template<typename T>
+	struct span
+	{
+		T* data;
+		size_t size;
+
+		T* begin() const { return data; }
+		T* end() const { return data + size; }
+		T& operator[](size_t i) const { return data[i]; }
+	};
+
+	// Bump allocator for data that only lives for one frame. Memory handed
+	// out is uninitialised and is reclaimed all at once by reset. When a frame
+	// needs more than one block, reset replaces them with a single block with
+	// headroom over the peak, so a steady state frame never touches the heap.
+	class framearena
+	{
+	public:
+		explicit framearena(size_t initialBytes = 0);
+
+		framearena(const framearena&) = delete;
+		framearena& operator=(const framearena&) = delete;
+
+		void reset();
+
+		template<typename T>
+		span<T> alloc(size_t count, size_t alignment = alignof(T));
+
+		size_t getUsedBytes() const;
+		size_t getPeakBytes() const;
+		size_t getCapacityBytes() const;
+		size_t getHeapAllocations() const;
+	private:
+		struct block
+		{
+			std::unique_ptr<uint8_t[]> data;
+			size_t size;
+		};
+
+		void* allocBytes(size_t bytes, size_t alignment);
+		void addBlock(size_t minBytes);
+
+		std::vector<block> blocks;
+		size_t current;
+		size_t offset;
+		size_t used;
+		size_t peak;
+		size_t heapAllocations;
+	};
+
+	inline framearena::framearena(size_t initialBytes) :
+		current(0), offset(0), used(0), peak(0), heapAllocations(0)
+	{
+		if(initialBytes > 0)
+			addBlock(initialBytes);
+	}
+
+	inline void framearena::reset()
+	{
+		constexpr size_t ALIGNMENT_SLACK = 256;
+
+		if(blocks.size() > 1)
+		{
+			blocks.clear();
+			addBlock(peak + peak / 2 + ALIGNMENT_SLACK);
+		}
+
+		current = 0;
+		offset = 0;
+		used = 0;
+	}
+
+	template<typename T>
+	span<T> framearena::alloc(size_t count, size_t alignment)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "Arena memory is never destructed.");
+
+		if(count == 0)
+			return span<T>{nullptr, 0};
+
+		return span<T>{(T*)allocBytes(count * sizeof(T), std::max(alignment, alignof(T))), count};
+	}
+
+	inline size_t framearena::getUsedBytes() const
+	{
+		return used;
+	}
+
+	inline size_t framearena::getPeakBytes() const
+	{
+		return peak;
+	}
+
+	inline size_t framearena::getCapacityBytes() const
+	{
+		size_t capacity = 0;
+		for(const auto& b : blocks)
+			capacity += b.size;
+		return capacity;
+	}
+
+	inline size_t framearena::getHeapAllocations() const
+	{
+		return heapAllocations;
+	}
+
+	inline void* framearena::allocBytes(size_t bytes, size_t alignment)
+	{
+		while(true)
+		{
+			if(current < blocks.size())
+			{
+				const uintptr_t base = (uintptr_t)blocks[current].data.get();
+				const uintptr_t aligned = (base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+				const size_t end = (size_t)(aligned - base) + bytes;
+
+				if(end <= blocks[current].size)
+				{
+					used += end - offset;
+					peak = std::max(peak, used);
+					offset = end;
+					return (void*)aligned;
+				}
+
+				if(current + 1 < blocks.size())
+				{
+					current++;
+					offset = 0;
+					continue;
+				}
+			}
+
+			addBlock(std::max(bytes + alignment, getCapacityBytes()));
+			current = blocks.size() - 1;
+			offset = 0;
+		}
+	}
+
+	inline void framearena::addBlock(size_t minBytes)
+	{
+		blocks.push_back(block{std::make_unique<uint8_t[]>(minBytes), minBytes});
+		heapAllocations++;
+	}
+}
+
+#endif
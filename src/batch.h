@@ -0,0 +1,181 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "render.h"
+#include "frame.h"
+#include "pvs.h"
+#include "arena.h"
+#include "map.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <memory>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+namespace batch
+{
+	struct pose
+	{
+		Vec2f pos;
+		float angle;
+	};
+
+	// Every texture of a level loaded up front. It is only read once loaded,
+	// so all workers can share one instance. Like map::texcache it hands out
+	// the placeholder for ids without a texture.
+	struct texarray
+	{
+		std::vector<std::shared_ptr<map::tex>> textures;
+		map::tex placeholder;
+
+		const map::tex& get(int id) const
+		{
+			if(id < 0 || id >= (int)textures.size())
+				return placeholder;
+			return *textures[id];
+		}
+	};
+
+	inline bool load_textures(const map::level& level, texarray& out)
+	{
+		map::make_placeholder_texture(out.placeholder);
+		out.textures.clear();
+		for(const auto& fileName : level.textures)
+		{
+			auto texture = map::load_texture_from_bmp(fileName);
+			if(!texture)
+				return false;
+			out.textures.push_back(std::move(texture));
+		}
+		return true;
+	}
+
+	inline bool load_poses(const std::string& fileName, std::vector<pose>& out)
+	{
+		std::ifstream file(fileName);
+
+		if(!file.is_open())
+		{
+			std::cerr << "Error loadPoses: The file " << fileName << " did not open." << std::endl;
+			return false;
+		}
+
+		std::string line;
+		int lineNumber = 0;
+		while(std::getline(file, line))
+		{
+			lineNumber++;
+
+			const size_t first = line.find_first_not_of(" \t\r");
+			if(first == std::string::npos || line[first] == '#')
+				continue;
+
+			std::istringstream stream(line);
+			float x, y, angle;
+			if(!(stream >> x >> y >> angle))
+			{
+				std::cerr << "Error loadPoses: The file " << fileName << " has a bad pose on line " << lineNumber << "." << std::endl;
+				return false;
+			}
+			out.push_back(pose{{x, y}, angle});
+		}
+		return true;
+	}
+
+	inline bool write_bmp(const std::string& fileName, int width, int height, int pitch, const uint8_t* buffer)
+	{
+		std::ofstream file(fileName, std::ios::binary | std::ios::out | std::ios::trunc);
+
+		if(!file.is_open())
+		{
+			std::cerr << "Error writeBmp: The file " << fileName << " did not open." << std::endl;
+			return false;
+		}
+
+		constexpr int32_t HEADER_SIZE = 14 + 40;
+		const int32_t rowSize = width * 4;
+		const int32_t imageSize = rowSize * height;
+
+		uint8_t header[HEADER_SIZE] = {'B', 'M'};
+		auto put32 = [&header](int offset, int32_t value)
+		{
+			for(int i = 0; i < 4; i++)
+				header[offset + i] = (uint8_t)(value >> (i * 8));
+		};
+		put32(2, HEADER_SIZE + imageSize);
+		put32(10, HEADER_SIZE);
+		put32(14, 40);
+		put32(18, width);
+		put32(22, height);
+		header[26] = 1;
+		header[28] = 32;
+		put32(34, imageSize);
+
+		file.write((const char*)header, HEADER_SIZE);
+		for(int y = height - 1; y >= 0; y--)
+			file.write((const char*)buffer + y * pitch, rowSize);
+
+		return (bool)file;
+	}
+
+	// Renders every pose into its own frame buffer and writes it to
+	// outDir/<pose index>.bmp. Returns the number of images written.
+	template<typename TexSource>
+	int render_poses(const map::level& level, const TexSource& textures, const std::vector<pose>& poses,
+		int width, int height, const std::string& outDir, int threadCount)
+	{
+		render::buffer_width = width;
+		render::buffer_height = height;
+
+		std::atomic<size_t> nextPose(0);
+		std::atomic<int> written(0);
+
+		pvs::sectorwalls sectorWalls;
+		pvs::build_sector_walls(level, sectorWalls);
+
+		pvs::sectorthings sectorThings;
+		pvs::build_sector_things(level, sectorWalls, sectorThings);
+
+		auto worker = [&]()
+		{
+			arena::framearena frameArena;
+
+			const int pitch = width * 4;
+			std::vector<uint8_t> frame((size_t)pitch * height);
+
+			char fileName[32];
+
+			for(size_t i = nextPose++; i < poses.size(); i = nextPose++)
+			{
+				const auto& p = poses[i];
+
+				const int sector = pvs::locate_sector(level, sectorWalls, p.pos, -1);
+				render::render_frame(level, sectorWalls, sectorThings, sector, textures, frameArena,
+					p.pos, p.angle, width, height, pitch, frame.data());
+
+				std::snprintf(fileName, sizeof(fileName), "/%05zu.bmp", i);
+				if(write_bmp(outDir + fileName, width, height, pitch, frame.data()))
+					written++;
+			}
+		};
+
+		threadCount = std::max(1, std::min(threadCount, (int)poses.size()));
+
+		std::vector<std::thread> workers;
+		for(int i = 1; i < threadCount; i++)
+			workers.emplace_back(worker);
+		worker();
+		for(auto& t : workers)
+			t.join();
+
+		return written;
+	}
+}
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+namespace capture
+{
+	// Stream layout: "ARGB", int32 width, int32 height, then for every frame a
+	// uint64 frame index, an int64 timestamp in microseconds and the pixels
+	// exactly as they are laid out in the screen buffer.
+	struct frameheader
+	{
+		uint64_t index;
+		int64_t timestamp;
+	};
+
+	// Single producer (render thread), single consumer (writer thread) ring.
+	// When the writer falls behind push drops the frame instead of waiting.
+	// A file that fails to open or write stops the capture, after which push
+	// ignores frames and close reports the failure.
+	class recorder
+	{
+	public:
+		recorder(const std::string& fileName, int width, int height, int pitch, int slotCount);
+		~recorder();
+
+		recorder(const recorder&) = delete;
+		recorder& operator=(const recorder&) = delete;
+
+		bool isOpen() const;
+		bool hasFailed() const;
+		bool push(const uint8_t* buffer);
+		bool close();
+
+		uint64_t getWritten() const;
+		uint64_t getDropped() const;
+	private:
+		void writerLoop();
+
+		std::ofstream file;
+		const int width;
+		const int height;
+		const int pitch;
+		const size_t frameBytes;
+		const size_t slotCount;
+
+		std::unique_ptr<uint8_t[]> frames;
+		std::unique_ptr<frameheader[]> headers;
+
+		alignas(64) std::atomic<size_t> writeIndex;
+		alignas(64) std::atomic<size_t> readIndex;
+		alignas(64) std::atomic<uint64_t> written;
+		std::atomic<bool> running;
+		std::atomic<bool> failed;
+
+		uint64_t nextFrame;
+		uint64_t dropped;
+		std::chrono::steady_clock::time_point start;
+
+		std::thread writer;
+	};
+
+	inline recorder::recorder(const std::string& fileName, int width, int height, int pitch, int slotCount) :
+		file(fileName, std::ios::binary | std::ios::out | std::ios::trunc),
+		width(width), height(height), pitch(pitch),
+		frameBytes((size_t)pitch * height), slotCount(slotCount),
+		frames(std::make_unique<uint8_t[]>(frameBytes * slotCount)),
+		headers(std::make_unique<frameheader[]>(slotCount)),
+		writeIndex(0), readIndex(0), written(0), running(true), failed(false),
+		nextFrame(0), dropped(0), start(std::chrono::steady_clock::now())
+	{
+		if(!file.is_open())
+		{
+			std::cerr << "Error capture::recorder: The file " << fileName << " did not open." << std::endl;
+			failed = true;
+			return;
+		}
+
+		const int32_t header[2] = {width, height};
+		file.write("ARGB", 4);
+		file.write((const char*)header, sizeof(header));
+
+		if(!file)
+		{
+			std::cerr << "Error capture::recorder: Could not write to " << fileName << "." << std::endl;
+			failed = true;
+			return;
+		}
+
+		writer = std::thread(&recorder::writerLoop, this);
+	}
+
+	inline recorder::~recorder()
+	{
+		close();
+	}
+
+	inline bool recorder::isOpen() const
+	{
+		return writer.joinable();
+	}
+
+	inline bool recorder::hasFailed() const
+	{
+		return failed.load(std::memory_order_acquire);
+	}
+
+	// Writes out the frames still in the ring and stops the writer. Returns
+	// false when any part of the capture could not be written.
+	inline bool recorder::close()
+	{
+		running.store(false, std::memory_order_release);
+		if(writer.joinable())
+			writer.join();
+		return !hasFailed();
+	}
+
+	inline bool recorder::push(const uint8_t* buffer)
+	{
+		if(!isOpen() || hasFailed())
+			return false;
+
+		const uint64_t frameIndex = nextFrame++;
+
+		const size_t head = writeIndex.load(std::memory_order_relaxed);
+		if(head - readIndex.load(std::memory_order_acquire) == slotCount)
+		{
+			dropped++;
+			return false;
+		}
+
+		const size_t slot = head % slotCount;
+		headers[slot].index = frameIndex;
+		headers[slot].timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+		std::memcpy(frames.get() + slot * frameBytes, buffer, frameBytes);
+
+		writeIndex.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	inline uint64_t recorder::getWritten() const
+	{
+		return written.load(std::memory_order_relaxed);
+	}
+
+	inline uint64_t recorder::getDropped() const
+	{
+		return dropped;
+	}
+
+	inline void recorder::writerLoop()
+	{
+		while(true)
+		{
+			const size_t tail = readIndex.load(std::memory_order_relaxed);
+			if(tail == writeIndex.load(std::memory_order_acquire))
+			{
+				if(!running.load(std::memory_order_acquire) &&
+					tail == writeIndex.load(std::memory_order_acquire))
+					break;
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				continue;
+			}
+
+			const size_t slot = tail % slotCount;
+			file.write((const char*)&headers[slot], sizeof(frameheader));
+			file.write((const char*)frames.get() + slot * frameBytes, frameBytes);
+
+			if(!file)
+			{
+				std::cerr << "Error capture::recorder: Writing frame " << headers[slot].index << " failed." << std::endl;
+				failed.store(true, std::memory_order_release);
+				return;
+			}
+
+			readIndex.store(tail + 1, std::memory_order_release);
+			written.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		file.flush();
+		if(!file)
+		{
+			std::cerr << "Error capture::recorder: Flushing the capture failed." << std::endl;
+			failed.store(true, std::memory_order_release);
+		}
+	}
+}
+
+#endif
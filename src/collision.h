@@ -0,0 +1,299 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include "Math/Math.h"
+#include "map.h"
+#include "pvs.h"
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+namespace collision
+{
+	// Uniform grid over the level walls. Each cell lists the walls passing
+	// through it, packed so that cell c owns wallIds[cellStart[c]..cellStart[c + 1]).
+	struct wallgrid
+	{
+		Vec2f origin;
+		float cellSize;
+		int cols;
+		int rows;
+		float maxStep;
+		float minClearance;
+		std::vector<int> cellStart;
+		std::vector<int> wallIds;
+		std::vector<uint8_t> blocking;
+	};
+
+	struct hit
+	{
+		float t;
+		Vec2f normal;
+	};
+
+	// One sided walls always block. Two sided walls block when the step
+	// between the floors or the gap between floor and ceiling is impassable.
+	template<typename SideIt, typename SectorIt>
+	bool wall_blocks(const map::wall& w, SideIt sideArr, SectorIt sectorArr, float maxStep, float minClearance)
+	{
+		if(w.frontId < 0 || w.backId < 0)
+			return true;
+
+		const auto& front = sectorArr[sideArr[w.frontId].sectorId];
+		const auto& back = sectorArr[sideArr[w.backId].sectorId];
+
+		const float floor = std::max(front.floorHeight, back.floorHeight);
+		const float ceiling = std::min(front.ceilingHeight, back.ceilingHeight);
+
+		return std::abs(front.floorHeight - back.floorHeight) > maxStep || ceiling - floor < minClearance;
+	}
+
+	template<typename WallIt, typename SideIt, typename SectorIt>
+	void build_wall_grid(WallIt wallBeg, const WallIt wallEnd, SideIt sideArr, SectorIt sectorArr,
+		float cellSize, float maxStep, float minClearance, wallgrid& grid)
+	{
+		grid.cellSize = cellSize;
+		grid.maxStep = maxStep;
+		grid.minClearance = minClearance;
+
+		float minX = 0.0f, minY = 0.0f, maxX = 0.0f, maxY = 0.0f;
+		for(auto it = wallBeg; it != wallEnd; ++it)
+		{
+			if(it == wallBeg)
+			{
+				minX = maxX = it->p0.getX();
+				minY = maxY = it->p0.getY();
+			}
+			for(const Vec2f& p : {it->p0, it->p1})
+			{
+				minX = std::min(minX, p.getX());
+				minY = std::min(minY, p.getY());
+				maxX = std::max(maxX, p.getX());
+				maxY = std::max(maxY, p.getY());
+			}
+		}
+
+		grid.origin = {minX, minY};
+		grid.cols = (int)((maxX - minX) / cellSize) + 1;
+		grid.rows = (int)((maxY - minY) / cellSize) + 1;
+
+		const float halfDiagonal = cellSize * 0.70711f;
+
+		// Calls f(cell) for every cell a wall passes through. Cells of the
+		// bounding box are rejected when the wall misses their circumcircle.
+		auto forEachCell = [&grid, halfDiagonal](const map::wall& w, auto f)
+		{
+			const int x0 = (int)((std::min(w.p0.getX(), w.p1.getX()) - grid.origin.getX()) / grid.cellSize);
+			const int x1 = (int)((std::max(w.p0.getX(), w.p1.getX()) - grid.origin.getX()) / grid.cellSize);
+			const int y0 = (int)((std::min(w.p0.getY(), w.p1.getY()) - grid.origin.getY()) / grid.cellSize);
+			const int y1 = (int)((std::max(w.p0.getY(), w.p1.getY()) - grid.origin.getY()) / grid.cellSize);
+
+			for(int y = y0; y <= y1; y++)
+			{
+				for(int x = x0; x <= x1; x++)
+				{
+					const Vec2f center = grid.origin + Vec2f(x + 0.5f, y + 0.5f) * grid.cellSize;
+					if((closestPointOnSegment(center, w.p0, w.p1) - center).length() <= halfDiagonal)
+						f(x + y * grid.cols);
+				}
+			}
+		};
+
+		const int cellCount = grid.cols * grid.rows;
+		grid.cellStart.assign(cellCount + 1, 0);
+		grid.blocking.clear();
+
+		for(auto it = wallBeg; it != wallEnd; ++it)
+		{
+			grid.blocking.push_back(wall_blocks(*it, sideArr, sectorArr, maxStep, minClearance));
+			forEachCell(*it, [&grid](int cell){ grid.cellStart[cell + 1]++; });
+		}
+
+		for(int c = 0; c < cellCount; c++)
+			grid.cellStart[c + 1] += grid.cellStart[c];
+
+		grid.wallIds.resize(grid.cellStart[cellCount]);
+		std::vector<int> cursor(grid.cellStart.begin(), grid.cellStart.end() - 1);
+
+		int wallId = 0;
+		for(auto it = wallBeg; it != wallEnd; ++it, ++wallId)
+			forEachCell(*it, [&grid, &cursor, wallId](int cell){ grid.wallIds[cursor[cell]++] = wallId; });
+	}
+
+	// Recomputes the blocking flag of the walls around the given sectors
+	// only, for use after their heights changed.
+	template<typename WallIt, typename SideIt, typename SectorIt, typename SectorIdIt>
+	void update_wall_blocking(wallgrid& grid, WallIt wallArr, SideIt sideArr, SectorIt sectorArr,
+		const pvs::sectorwalls& walls, SectorIdIt dirtyBeg, const SectorIdIt dirtyEnd)
+	{
+		while(dirtyBeg != dirtyEnd)
+		{
+			const int sector = *dirtyBeg;
+			++dirtyBeg;
+
+			for(int i = walls.start[sector]; i < walls.start[sector + 1]; i++)
+			{
+				const int wallId = walls.wallIds[i];
+				grid.blocking[wallId] = wall_blocks(wallArr[wallId], sideArr, sectorArr, grid.maxStep, grid.minClearance);
+			}
+		}
+	}
+
+	// Calls f(wallId) for every blocking wall in the cells touching the box.
+	// A wall spanning several cells can be reported more than once.
+	template<typename F>
+	void for_each_blocking_wall(const wallgrid& grid, Vec2f boxMin, Vec2f boxMax, F f)
+	{
+		const int x0 = std::max((int)std::floor((boxMin.getX() - grid.origin.getX()) / grid.cellSize), 0);
+		const int y0 = std::max((int)std::floor((boxMin.getY() - grid.origin.getY()) / grid.cellSize), 0);
+		const int x1 = std::min((int)std::floor((boxMax.getX() - grid.origin.getX()) / grid.cellSize), grid.cols - 1);
+		const int y1 = std::min((int)std::floor((boxMax.getY() - grid.origin.getY()) / grid.cellSize), grid.rows - 1);
+
+		for(int y = y0; y <= y1; y++)
+		{
+			for(int x = x0; x <= x1; x++)
+			{
+				const int cell = x + y * grid.cols;
+				for(int i = grid.cellStart[cell]; i < grid.cellStart[cell + 1]; i++)
+				{
+					const int wallId = grid.wallIds[i];
+					if(grid.blocking[wallId])
+						f(wallId);
+				}
+			}
+		}
+	}
+
+	// Earliest time in [0, 1] at which a circle moving from pos by delta
+	// touches the point p.
+	inline bool sweep_circle_point(Vec2f pos, Vec2f delta, float radius, Vec2f p, hit& result)
+	{
+		const Vec2f m = pos - p;
+		const float a = delta.dot(delta);
+		const float b = 2.0f * m.dot(delta);
+		const float c = m.dot(m) - radius * radius;
+
+		if(c < 0.0f)
+		{
+			if(b >= 0.0f)
+				return false;
+			result = {0.0f, m.getUnit()};
+			return true;
+		}
+
+		const float discriminant = b * b - 4.0f * a * c;
+		if(a <= 0.0f || discriminant < 0.0f)
+			return false;
+
+		const float t = (-b - std::sqrt(discriminant)) / (2.0f * a);
+		if(t < 0.0f || t > 1.0f)
+			return false;
+
+		result = {t, (pos + delta * t - p).getUnit()};
+		return true;
+	}
+
+	inline bool sweep_circle_segment(Vec2f pos, Vec2f delta, float radius, Vec2f p0, Vec2f p1, hit& result)
+	{
+		const Vec2f dir = p1 - p0;
+		const float length = dir.length();
+		if(length <= 0.0f)
+			return sweep_circle_point(pos, delta, radius, p0, result);
+
+		Vec2f normal = (dir / length).rotate(HALF_PI);
+		float dist = distFromLine(pos, p0, normal);
+		if(dist < 0.0f)
+		{
+			normal = -normal;
+			dist = -dist;
+		}
+
+		bool found = false;
+		const float approach = -delta.dot(normal);
+		if(approach > 0.0f)
+		{
+			const float t = std::max((dist - radius) / approach, 0.0f);
+			const float along = (pos + delta * t - p0).dot(dir) / length;
+			if(t <= 1.0f && along >= 0.0f && along <= length)
+			{
+				result = {t, normal};
+				found = true;
+			}
+		}
+
+		hit cap;
+		for(const Vec2f& p : {p0, p1})
+		{
+			if(sweep_circle_point(pos, delta, radius, p, cap) && (!found || cap.t < result.t))
+			{
+				result = cap;
+				found = true;
+			}
+		}
+
+		return found;
+	}
+
+	// Moves a circle by delta, stopping at the first wall it touches and
+	// sliding along it with what is left of the move.
+	template<typename WallIt>
+	Vec2f move_circle(const wallgrid& grid, WallIt wallArr, Vec2f pos, Vec2f delta, float radius)
+	{
+		constexpr int MAX_SLIDES = 3;
+		constexpr float SKIN = 0.001f;
+
+		for(int slide = 0; slide < MAX_SLIDES && delta.dot(delta) > 0.0f; slide++)
+		{
+			const Vec2f end = pos + delta;
+			const Vec2f boxMin(std::min(pos.getX(), end.getX()) - radius, std::min(pos.getY(), end.getY()) - radius);
+			const Vec2f boxMax(std::max(pos.getX(), end.getX()) + radius, std::max(pos.getY(), end.getY()) + radius);
+
+			hit first = {2.0f, {0.0f}};
+			for_each_blocking_wall(grid, boxMin, boxMax, [&](int wallId)
+			{
+				hit h;
+				const auto& w = wallArr[wallId];
+				if(sweep_circle_segment(pos, delta, radius, w.p0, w.p1, h) && h.t < first.t)
+					first = h;
+			});
+
+			if(first.t > 1.0f)
+			{
+				pos = end;
+				break;
+			}
+
+			pos += delta * first.t + first.normal * SKIN;
+			delta = delta * (1.0f - first.t);
+			delta -= first.normal * delta.dot(first.normal);
+		}
+
+		const Vec2f boxMin = pos - Vec2f(radius);
+		const Vec2f boxMax = pos + Vec2f(radius);
+		for_each_blocking_wall(grid, boxMin, boxMax, [&](int wallId)
+		{
+			const auto& w = wallArr[wallId];
+			const Vec2f away = pos - closestPointOnSegment(pos, w.p0, w.p1);
+			const float dist = away.length();
+			if(dist > 0.0f && dist < radius)
+				pos += away * ((radius - dist) / dist);
+		});
+
+		return pos;
+	}
+
+	template<typename WallIt, typename PosIt, typename DeltaIt>
+	void move_circles(const wallgrid& grid, WallIt wallArr, PosIt posBeg, const PosIt posEnd,
+		DeltaIt deltaBeg, float radius)
+	{
+		while(posBeg != posEnd)
+		{
+			*posBeg = move_circle(grid, wallArr, *posBeg, *deltaBeg, radius);
+			++posBeg;
+			++deltaBeg;
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "render.h"
+#include "sprite.h"
+#include "pvs.h"
+#include "arena.h"
+#include "map.h"
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+
+namespace render
+{
+	// Draws the level as seen from pos into buffer: the walls of the sectors
+	// visible from sector, then the sprites standing in them. Every stage
+	// buffer comes from frameArena, which is reset first. A sector of -1
+	// draws everything.
+	template<typename TexSource>
+	void render_frame(const map::level& level, const pvs::sectorwalls& sectorWalls,
+		const pvs::sectorthings& sectorThings, int sector, TexSource& textures, arena::framearena& frameArena,
+		const Vec2f pos, const float angle, int width, int height, int pitch, uint8_t* buffer)
+	{
+		frameArena.reset();
+
+		std::fill(buffer, buffer + (size_t)pitch * height, 0x00);
+
+		auto columnDepth = frameArena.alloc<float>(width);
+		std::fill(columnDepth.begin(), columnDepth.end(), std::numeric_limits<float>::max());
+
+		auto visibleWalls = frameArena.alloc<map::wall>(pvs::max_visible_walls(level, sectorWalls, sector));
+		auto visibleWallsEndIt = visibleWalls.begin();
+		pvs::gather_visible_walls(level, sectorWalls, sector, visibleWalls.begin(), visibleWallsEndIt);
+
+		auto translatedWalls = frameArena.alloc<map::wall>(visibleWallsEndIt - visibleWalls.begin());
+		auto translatedWallsEndIt = translatedWalls.begin();
+		translate_walls(pos, angle, visibleWalls.begin(), visibleWallsEndIt, translatedWalls.begin(), translatedWallsEndIt);
+
+		auto clippedWalls = frameArena.alloc<clippedwall>(translatedWallsEndIt - translatedWalls.begin());
+		auto clippedWallsEndIt = clippedWalls.begin();
+		clip_walls(translatedWalls.begin(), translatedWallsEndIt, clippedWalls.begin(), clippedWallsEndIt);
+
+		auto screenCoords = frameArena.alloc<screencoord>(clippedWallsEndIt - clippedWalls.begin());
+		auto screenCoordsEndIt = screenCoords.begin();
+		gen_screen_coords(clippedWalls.begin(), clippedWallsEndIt, screenCoords.begin(), screenCoordsEndIt,
+			level.sides.begin(), level.sectors.begin());
+
+		output_to_screen_buffer(screenCoords.begin(), screenCoordsEndIt, level.sides.begin(), textures,
+			width, height, pitch, buffer, columnDepth.data);
+
+		auto visibleThings = frameArena.alloc<map::thing>(pvs::max_visible_things(level, sectorThings, sector));
+		auto visibleThingsEndIt = visibleThings.begin();
+		pvs::gather_visible_things(level, sectorThings, sector, visibleThings.begin(), visibleThingsEndIt);
+
+		auto translatedThings = frameArena.alloc<map::thing>(visibleThingsEndIt - visibleThings.begin());
+		auto translatedThingsEndIt = translatedThings.begin();
+		translate_things(pos, angle, visibleThings.begin(), visibleThingsEndIt, translatedThings.begin(), translatedThingsEndIt);
+
+		auto spriteCoords = frameArena.alloc<spritecoord>(translatedThingsEndIt - translatedThings.begin());
+		auto spriteCoordsEndIt = spriteCoords.begin();
+		gen_sprite_coords(translatedThings.begin(), translatedThingsEndIt, spriteCoords.begin(), spriteCoordsEndIt);
+
+		spritebins spriteBins;
+		bin_sprites(spriteCoords.begin(), spriteCoordsEndIt, width, frameArena, spriteBins);
+		output_sprites_to_screen_buffer(spriteCoords.begin(), spriteBins, textures, columnDepth.data,
+			width, height, pitch, buffer);
+	}
+}
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "map.h"
+#include <cstdint>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RENDER_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace render
+{
+	// Writes count pixels down one screen column starting at dest. Pixel i
+	// samples the texture at column u and row v + i * vStep. Both u and v are
+	// in texels and wrap around the texture. Every kernel computes the rows
+	// the same way, so the output does not depend on which one the CPU gets.
+	// Walls and sprites are the only things drawn, both a column at a time;
+	// floors and ceilings are left black, so there are no row spans to fill.
+	using columnkernel = void (*)(uint32_t* dest, int destPitch, int count,
+		const map::tex& tex, float u, float v, float vStep);
+
+	namespace kernels
+	{
+		inline int wrap(int i, int size)
+		{
+			i %= size;
+			return i < 0 ? i + size : i;
+		}
+
+		// Blends two ARGB texels, weight 0 gives a and 256 gives b.
+		inline uint32_t lerp_texel(uint32_t a, uint32_t b, uint32_t weight)
+		{
+			const uint32_t inverse = 256 - weight;
+			const uint32_t rb = (((a & 0x00FF00FF) * inverse + (b & 0x00FF00FF) * weight) >> 8) & 0x00FF00FF;
+			const uint32_t ag = (((a >> 8) & 0x00FF00FF) * inverse + ((b >> 8) & 0x00FF00FF) * weight) & 0xFF00FF00;
+			return rb | ag;
+		}
+
+		// Pixels first..count - 1 of a column, dest pointing at pixel first.
+		inline void nearest_pixels(uint32_t* dest, int destPitch, int first, int count,
+			const map::tex& tex, float u, float v, float vStep)
+		{
+			const uint32_t* texels = (const uint32_t*)tex.data.get() + wrap((int)std::floor(u), tex.width);
+			const int texPitch = tex.pitch / map::tex::BYTES_PER_PIXEL;
+
+			for(int i = first; i < count; i++)
+			{
+				*dest = texels[wrap((int)std::floor(v + i * vStep), tex.height) * texPitch];
+				dest += destPitch;
+			}
+		}
+
+		inline void bilinear_pixels(uint32_t* dest, int destPitch, int first, int count,
+			const map::tex& tex, float u, float v, float vStep)
+		{
+			const uint32_t* texels = (const uint32_t*)tex.data.get();
+			const int texPitch = tex.pitch / map::tex::BYTES_PER_PIXEL;
+
+			const float uf = std::floor(u - 0.5f);
+			const uint32_t uWeight = (uint32_t)((u - 0.5f - uf) * 256.0f);
+			const int u0 = wrap((int)uf, tex.width);
+			const int u1 = wrap(u0 + 1, tex.width);
+
+			v -= 0.5f;
+			for(int i = first; i < count; i++)
+			{
+				const float vi = v + i * vStep;
+				const float vf = std::floor(vi);
+				const uint32_t vWeight = (uint32_t)((vi - vf) * 256.0f);
+				const uint32_t* row0 = texels + wrap((int)vf, tex.height) * texPitch;
+				const uint32_t* row1 = texels + wrap((int)vf + 1, tex.height) * texPitch;
+
+				*dest = lerp_texel(lerp_texel(row0[u0], row0[u1], uWeight),
+					lerp_texel(row1[u0], row1[u1], uWeight), vWeight);
+				dest += destPitch;
+			}
+		}
+
+		inline void column_nearest(uint32_t* dest, int destPitch, int count,
+			const map::tex& tex, float u, float v, float vStep)
+		{
+			nearest_pixels(dest, destPitch, 0, count, tex, u, v, vStep);
+		}
+
+		inline void column_bilinear(uint32_t* dest, int destPitch, int count,
+			const map::tex& tex, float u, float v, float vStep)
+		{
+			bilinear_pixels(dest, destPitch, 0, count, tex, u, v, vStep);
+		}
+
+#ifdef RENDER_AVX2_KERNELS
+		// Floors eight texel coordinates and wraps them into [0, size), the
+		// same as wrap((int)std::floor(v), size). The floored values and their
+		// multiples of size are exact in float, and the reciprocal can only
+		// be one turn off, which the last two steps correct.
+		__attribute__((target("avx2")))
+		inline __m256i wrap8(__m256 v, float size)
+		{
+			const __m256 f = _mm256_floor_ps(v);
+			const __m256 turns = _mm256_floor_ps(_mm256_mul_ps(f, _mm256_set1_ps(1.0f / size)));
+			__m256i i = _mm256_cvttps_epi32(_mm256_sub_ps(f, _mm256_mul_ps(turns, _mm256_set1_ps(size))));
+
+			const __m256i sizes = _mm256_set1_epi32((int)size);
+			i = _mm256_add_epi32(i, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), i), sizes));
+			i = _mm256_sub_epi32(i, _mm256_andnot_si256(_mm256_cmpgt_epi32(sizes, i), sizes));
+			return i;
+		}
+
+		// Rows v + (first + lane) * vStep of eight pixels starting at first.
+		__attribute__((target("avx2")))
+		inline __m256 rows8(float v, float vStep, int first)
+		{
+			const __m256 index = _mm256_add_ps(_mm256_set1_ps((float)first), _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0));
+			return _mm256_add_ps(_mm256_set1_ps(v), _mm256_mul_ps(index, _mm256_set1_ps(vStep)));
+		}
+
+		__attribute__((target("avx2")))
+		inline __m256i lerp_texel8(__m256i a, __m256i b, __m256i weight)
+		{
+			const __m256i mask = _mm256_set1_epi32(0x00FF00FF);
+			const __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(256), weight);
+
+			const __m256i rb = _mm256_srli_epi16(_mm256_add_epi16(
+				_mm256_mullo_epi16(_mm256_and_si256(a, mask), inverse),
+				_mm256_mullo_epi16(_mm256_and_si256(b, mask), weight)), 8);
+			const __m256i ag = _mm256_add_epi16(
+				_mm256_mullo_epi16(_mm256_srli_epi16(a, 8), inverse),
+				_mm256_mullo_epi16(_mm256_srli_epi16(b, 8), weight));
+
+			return _mm256_or_si256(rb, _mm256_andnot_si256(mask, ag));
+		}
+
+		// The destination column is strided, so eight gathered texels are
+		// written back one at a time.
+		__attribute__((target("avx2")))
+		inline void store_column8(uint32_t*& dest, int destPitch, __m256i texels)
+		{
+			alignas(32) uint32_t lanes[8];
+			_mm256_store_si256((__m256i*)lanes, texels);
+			for(int i = 0; i < 8; i++)
+			{
+				*dest = lanes[i];
+				dest += destPitch;
+			}
+		}
+
+		__attribute__((target("avx2")))
+		inline void column_nearest_avx2(uint32_t* dest, int destPitch, int count,
+			const map::tex& tex, float u, float v, float vStep)
+		{
+			const int* texels = (const int*)tex.data.get() + wrap((int)std::floor(u), tex.width);
+			const __m256i texPitch = _mm256_set1_epi32(tex.pitch / map::tex::BYTES_PER_PIXEL);
+			const float height = (float)tex.height;
+
+			int i = 0;
+			for(; i + 8 <= count; i += 8)
+			{
+				const __m256i index = _mm256_mullo_epi32(wrap8(rows8(v, vStep, i), height), texPitch);
+				store_column8(dest, destPitch, _mm256_i32gather_epi32(texels, index, 4));
+			}
+
+			nearest_pixels(dest, destPitch, i, count, tex, u, v, vStep);
+		}
+
+		__attribute__((target("avx2")))
+		inline void column_bilinear_avx2(uint32_t* dest, int destPitch, int count,
+			const map::tex& tex, float u, float v, float vStep)
+		{
+			const int* texels = (const int*)tex.data.get();
+			const __m256i texPitch = _mm256_set1_epi32(tex.pitch / map::tex::BYTES_PER_PIXEL);
+			const float height = (float)tex.height;
+
+			const float uf = std::floor(u - 0.5f);
+			const __m256i uWeight = _mm256_set1_epi16((short)((u - 0.5f - uf) * 256.0f));
+			const int u0 = wrap((int)uf, tex.width);
+			const __m256i u0s = _mm256_set1_epi32(u0);
+			const __m256i u1s = _mm256_set1_epi32(wrap(u0 + 1, tex.width));
+
+			const __m256 one = _mm256_set1_ps(1.0f);
+
+			int i = 0;
+			for(; i + 8 <= count; i += 8)
+			{
+				const __m256 v8 = rows8(v - 0.5f, vStep, i);
+				const __m256 vf = _mm256_floor_ps(v8);
+				const __m256i vWeight32 = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(v8, vf), _mm256_set1_ps(256.0f)));
+				const __m256i vWeight = _mm256_or_si256(vWeight32, _mm256_slli_epi32(vWeight32, 16));
+
+				const __m256i row0 = _mm256_mullo_epi32(wrap8(vf, height), texPitch);
+				const __m256i row1 = _mm256_mullo_epi32(wrap8(_mm256_add_ps(vf, one), height), texPitch);
+
+				const __m256i t00 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row0, u0s), 4);
+				const __m256i t01 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row0, u1s), 4);
+				const __m256i t10 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row1, u0s), 4);
+				const __m256i t11 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row1, u1s), 4);
+
+				const __m256i top = lerp_texel8(t00, t01, uWeight);
+				const __m256i bottom = lerp_texel8(t10, t11, uWeight);
+				store_column8(dest, destPitch, lerp_texel8(top, bottom, vWeight));
+			}
+
+			bilinear_pixels(dest, destPitch, i, count, tex, u, v, vStep);
+		}
+#endif
+	}
+
+	inline columnkernel select_column_kernel(bool bilinear)
+	{
+#ifdef RENDER_AVX2_KERNELS
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2"))
+			return bilinear ? kernels::column_bilinear_avx2 : kernels::column_nearest_avx2;
+#endif
+		return bilinear ? kernels::column_bilinear : kernels::column_nearest;
+	}
+}
+
+#endif
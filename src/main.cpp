@@ -1,5 +1,13 @@
 #include "render.h"
+#include "frame.h"
 #include "map.h"
+#include "texcache.h"
+#include "capture.h"
+#include "batch.h"
+#include "collision.h"
+#include "pvs.h"
+#include "anim.h"
+#include "arena.h"
 #include <iostream>
 #include <SDL2/SDL.h>
 #include <memory>
@@ -10,11 +18,27 @@
 #include <thread>
 #include <string>
 #include <fstream>
+#include <cstdlib>
 
 // Här är skärm storleken.
 #define RES_W 640
 #define RES_H 480
 
+// Hur många bytes texturer som får ligga i minnet samtidigt.
+#define TEXTURE_BUDGET (4 * 1024 * 1024)
+
+// Antal bildrutor som kan vänta på att skrivas till disk vid inspelning.
+#define CAPTURE_SLOTS 32
+
+// Spelarens kollisionsradie och hur höga steg/låga öppningar den klarar.
+#define PLAYER_RADIUS 0.25f
+#define PLAYER_MAX_STEP 0.5f
+#define PLAYER_HEIGHT 1.0f
+#define COLLISION_CELL_SIZE 2.0f
+
+// Banan som laddas om ingen annan anges med --level.
+#define DEFAULT_LEVEL "res/levels/demo.lvl"
+
 // Denna funktor används som en anpassad destruktor i unique_ptrs av typen SDL_Window osv.
 struct SDL_Destroyer
 {
@@ -63,7 +87,7 @@ int limitFps(clock_type::time_point& startTime, clock_type::time_point& endTime)
 	return ticks;
 }
 
-void program()
+void program(map::level& level, const std::string& captureFile)
 {
 	std::cout << "SDL_CreateWindow(\"dod test\", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, RES_W, RES_H, 0);" << std::endl;
 	std::unique_ptr<SDL_Window, SDL_Destroyer> window(
@@ -81,6 +105,10 @@ void program()
 
 	std::unique_ptr<uint8_t[]> screenBuf = std::make_unique<uint8_t[]>(RES_W * RES_H * 4);
 
+	std::unique_ptr<capture::recorder> recorder;
+	if(!captureFile.empty())
+		recorder = std::make_unique<capture::recorder>(captureFile, RES_W, RES_H, RES_W * 4, CAPTURE_SLOTS);
+
 	render::buffer_width = RES_W;
 	render::buffer_height = RES_H;
 
@@ -94,44 +122,31 @@ void program()
 		{SDLK_SPACE, false}
 	};
 
-	std::array<map::wall, 7> walls = {
-		map::wall{{-4.0f, -3.0f}, {1.0f, -1.0f}, 0, -1},
-		map::wall{{1.0f, -1.0f}, {4.0f, 0.0f}, 1, -1},
-		map::wall{{4.0f, 0.0f}, {4.0f, 4.0f}, 2, -1},
-		map::wall{{4.0f, 4.0f}, {0.0f, 4.0f}, 3, -1},
-		map::wall{{0.0f, 4.0f}, {-1.0f, 1.0f}, 4, 5},
-		map::wall{{0.0f, 4.0f}, {-4.0f, 2.0f}, 6, -1},
-		map::wall{{-4.0f, 2.0f}, {-4.0f, -3.0f}, 7, -1}
-	};
-	std::array<map::wall, 7> translatedWalls;
-	std::array<render::clippedwall, 7> clippedWalls;
-	std::array<render::screencoord, 7> screenCoords;
-
-	auto brownBrick = map::load_texture_from_bmp("res/bmp/brown_brick.bmp");
-	auto grass = map::load_texture_from_bmp("res/bmp/grass.bmp");
-	auto planks = map::load_texture_from_bmp("res/bmp/planks.bmp");
-	auto redCarpet = map::load_texture_from_bmp("res/bmp/red_carpet.bmp");
-	auto sky = map::load_texture_from_bmp("res/bmp/sky.bmp");
-	auto stone_brick = map::load_texture_from_bmp("res/bmp/stone_brick.bmp");
-
-	map::texcoord defaultTexCoord = {0.0f, 1.0f, 0.0f, 1.0f};
-	std::array<map::side, 8> sides = {
-		map::side{nullptr, brownBrick, nullptr, defaultTexCoord, 0},
-		map::side{nullptr, stone_brick, nullptr, defaultTexCoord, 0},
-		map::side{nullptr, planks, nullptr, defaultTexCoord, 0},
-		map::side{nullptr, sky, nullptr, defaultTexCoord, 0},
-		map::side{nullptr, planks, nullptr, defaultTexCoord, 0},
-		map::side{nullptr, planks, nullptr, defaultTexCoord, 0},
-		map::side{nullptr, stone_brick, nullptr, defaultTexCoord, 0},
-		map::side{nullptr, brownBrick, nullptr, defaultTexCoord, 0},
-	};
+	pvs::sectorwalls sectorWalls;
+	pvs::build_sector_walls(level, sectorWalls);
 
-	std::array<map::sector, 1> sectors = {
-		map::sector{-1.0f, 1.0f, redCarpet, sky}
-	};
+	pvs::sectorthings sectorThings;
+	pvs::build_sector_things(level, sectorWalls, sectorThings);
+
+	map::texcache textures(TEXTURE_BUDGET);
+	for(const auto& fileName : level.textures)
+		textures.add(fileName);
+
+	anim::dirtyset dirty;
+	anim::init_dirty(level, dirty);
+
+	std::vector<float> occupantHeights;
+	anim::build_occupant_heights(level, sectorThings, occupantHeights);
+
+	collision::wallgrid wallGrid;
+	collision::build_wall_grid(level.walls.begin(), level.walls.end(), level.sides.begin(), level.sectors.begin(),
+		COLLISION_CELL_SIZE, PLAYER_MAX_STEP, PLAYER_HEIGHT, wallGrid);
+
+	arena::framearena frameArena;
 
 	Vec2f playerPos(0.0f);
 	float angle = 0.0f;
+	int playerSector = -1;
 
 	auto startTime = clock_type::now();
 	auto endTime = clock_type::now();
@@ -172,28 +187,39 @@ void program()
 			}
 		}
 
+		// Spelaren räknas som ett hinder för krossare i sektorn den står i.
+		const float thingHeight = playerSector >= 0 ? occupantHeights[playerSector] : 0.0f;
+		if(playerSector >= 0)
+			occupantHeights[playerSector] = std::max(thingHeight, PLAYER_HEIGHT);
+		anim::tick(level, occupantHeights, frameTime, dirty);
+		if(playerSector >= 0)
+			occupantHeights[playerSector] = thingHeight;
+
+		collision::update_wall_blocking(wallGrid, level.walls.begin(), level.sides.begin(), level.sectors.begin(),
+			sectorWalls, dirty.sectors.begin(), dirty.sectors.end());
+		anim::clear_dirty(dirty);
+
+		Vec2f playerMove(0.0f);
 		if(keyMap[SDLK_UP])
-			playerPos += Vec2f(std::cos(angle), std::sin(angle)) * frameTime * 2.0f;
+			playerMove += Vec2f(std::cos(angle), std::sin(angle)) * frameTime * 2.0f;
 		if(keyMap[SDLK_DOWN])
-			playerPos -= Vec2f(std::cos(angle), std::sin(angle)) * frameTime * 2.0f;
+			playerMove -= Vec2f(std::cos(angle), std::sin(angle)) * frameTime * 2.0f;
+
+		playerPos = collision::move_circle(wallGrid, level.walls.begin(), playerPos, playerMove, PLAYER_RADIUS);
+		playerSector = pvs::locate_sector(level, sectorWalls, playerPos, playerSector);
 
 		if(keyMap[SDLK_LEFT])
 			angle -= 2.0f * frameTime;
 		if(keyMap[SDLK_RIGHT])
 			angle += 2.0f * frameTime;
 
-		std::fill(screenBuf.get(), screenBuf.get() + RES_W * RES_H * 4, 0x00);
-
-		auto translatedWallsEndIt = translatedWalls.begin();
-		render::translate_walls(playerPos, angle, walls.begin(), walls.end(), translatedWalls.begin(), translatedWallsEndIt);
-
-		auto clippedWallsEndIt = clippedWalls.begin();
-		render::clip_walls(translatedWalls.begin(), translatedWallsEndIt, clippedWalls.begin(), clippedWallsEndIt);
+		textures.beginFrame();
 
-		auto screenCoordsEndIt = screenCoords.begin();
-		render::gen_screen_coords(clippedWalls.begin(), clippedWallsEndIt, screenCoords.begin(), screenCoordsEndIt, sides.begin(), sectors.begin());
+		render::render_frame(level, sectorWalls, sectorThings, playerSector, textures, frameArena,
+			playerPos, angle, RES_W, RES_H, RES_W * 4, screenBuf.get());
 
-		render::output_to_screen_buffer(screenCoords.begin(), screenCoordsEndIt, sides.begin(), RES_W, RES_H, RES_W * 4, screenBuf.get());
+		if(recorder)
+			recorder->push(screenBuf.get());
 
 		SDL_UpdateTexture(texture.get(), NULL, screenBuf.get(), RES_W * 4);
 
@@ -201,14 +227,126 @@ void program()
 		SDL_RenderCopy(renderer.get(), texture.get(), NULL, NULL);
 		SDL_RenderPresent(renderer.get());
 	}
+
+	std::cout << "Frame arena peak " << frameArena.getPeakBytes() << " bytes, "
+		<< frameArena.getHeapAllocations() << " heap allocations." << std::endl;
+
+	if(recorder)
+	{
+		if(recorder->close())
+			std::cout << "Captured " << recorder->getWritten() << " frames to " << captureFile << ", "
+				<< recorder->getDropped() << " dropped." << std::endl;
+		else
+			std::cerr << "Capture to " << captureFile << " failed after " << recorder->getWritten() << " frames." << std::endl;
+	}
+}
+
+// Räknar ut vilka sektorer som kan synas från varandra och sparar det i banfilen.
+int buildPvsProgram(const std::string& levelFile, const std::string& outFile)
+{
+	auto level = map::load_level(levelFile);
+	if(!level)
+		return 1;
+
+	auto startTime = clock_type::now();
+	const pvs::buildstats stats = pvs::build_pvs(*level);
+	auto endTime = clock_type::now();
+
+	std::cout << "Built pvs for " << level->sectors.size() << " sectors in "
+		<< std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count()
+		<< " ms, " << stats.oneWayPairs << " pairs only found one way." << std::endl;
+
+	if(stats.overBudgetSectors > 0)
+		std::cerr << "Warning: " << stats.overBudgetSectors << " sectors ran out of steps and see every sector connected to them." << std::endl;
+
+	return map::save_level(*level, outFile) ? 0 : 1;
+}
+
+// Banor utan sparad pvs får en uträknad vid start, vilket kan ta tid för stora banor.
+void buildMissingPvs(map::level& level, const std::string& levelFile)
+{
+	std::cerr << "Warning: " << levelFile << " has no pvs, building it now. Save one with --build-pvs to skip this." << std::endl;
+	pvs::build_pvs(level);
+}
+
+// Renderar varje position i poseFile utan fönster och sparar bilderna i outDir.
+int batchProgram(const std::string& levelFile, const std::string& poseFile,
+	const std::string& outDir, int threadCount)
+{
+	auto level = map::load_level(levelFile);
+	if(!level)
+		return 1;
+	if(level->pvs.empty())
+		buildMissingPvs(*level, levelFile);
+
+	batch::texarray textures;
+	if(!batch::load_textures(*level, textures))
+		return 1;
+
+	std::vector<batch::pose> poses;
+	if(!batch::load_poses(poseFile, poses))
+		return 1;
+
+	auto startTime = clock_type::now();
+	int written = batch::render_poses(*level, textures, poses, RES_W, RES_H, outDir, threadCount);
+	auto endTime = clock_type::now();
+
+	std::cout << "Rendered " << written << " of " << poses.size() << " poses on " << threadCount
+		<< " threads in " << std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count()
+		<< " ms." << std::endl;
+
+	return written == (int)poses.size() ? 0 : 1;
 }
 
 int main(int argc, char** argv)
 {
+	std::string levelFile = DEFAULT_LEVEL;
+	std::string captureFile;
+	std::string buildPvsArgs[2];
+	std::string batchArgs[3];
+	bool batchMode = false;
+	int threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	for(int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		if(arg == "--capture" && i + 1 < argc)
+			captureFile = argv[++i];
+		else if(arg == "--batch" && i + 3 < argc)
+		{
+			batchMode = true;
+			for(auto& batchArg : batchArgs)
+				batchArg = argv[++i];
+		}
+		else if(arg == "--level" && i + 1 < argc)
+			levelFile = argv[++i];
+		else if(arg == "--build-pvs" && i + 2 < argc)
+		{
+			for(auto& buildPvsArg : buildPvsArgs)
+				buildPvsArg = argv[++i];
+		}
+		else if(arg == "--bilinear")
+			render::wall_column_kernel = render::select_column_kernel(true);
+		else if(arg == "--threads" && i + 1 < argc)
+			threadCount = std::max(1, std::atoi(argv[++i]));
+	}
+
+	if(batchMode)
+		return batchProgram(batchArgs[0], batchArgs[1], batchArgs[2], threadCount);
+
+	if(!buildPvsArgs[0].empty())
+		return buildPvsProgram(buildPvsArgs[0], buildPvsArgs[1]);
+
+	auto level = map::load_level(levelFile);
+	if(!level)
+		return 1;
+	if(level->pvs.empty())
+		buildMissingPvs(*level, levelFile);
+
 	std::cout << "SDL_Init(SDL_INIT_VIDEO);" << std::endl;
 	SDL_Init(SDL_INIT_VIDEO);
 
-	program();
+	program(*level, captureFile);
 
 	std::cout << "SDL_Quit();" << std::endl;
 	SDL_Quit();
@@ -3,9 +3,14 @@
 
 #include "Math/Vec2.h"
 #include <string>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+#include <cstdint>
 #include <memory>
 #include <fstream>
 #include <iostream>
+#include <limits>
 
 namespace map
 {
@@ -37,9 +42,9 @@ namespace map
 
 	struct side
 	{
-		std::shared_ptr<tex> topTex;
-		std::shared_ptr<tex> midTex;
-		std::shared_ptr<tex> botTex;
+		int topTex;
+		int midTex;
+		int botTex;
 		texcoord texCoord;
 		int sectorId;
 	};
@@ -48,8 +53,49 @@ namespace map
 	{
 		float floorHeight;
 		float ceilingHeight;
-		std::shared_ptr<tex> floorTex;
-		std::shared_ptr<tex> ceilingTex;
+		int floorTex;
+		int ceilingTex;
+	};
+
+	struct thing
+	{
+		Vec2f pos;
+		float bottom;
+		float top;
+		float width;
+		int texId;
+	};
+
+	struct mover
+	{
+		enum class kind { DOOR, LIFT, CRUSHER };
+		kind type;
+		int sectorId;
+		float low;
+		float high;
+		float speed;
+		float wait;
+		float timer;
+		int direction;
+	};
+
+	struct scroller
+	{
+		int sideId;
+		float du;
+		float dv;
+	};
+
+	struct level
+	{
+		std::vector<std::string> textures;
+		std::vector<sector> sectors;
+		std::vector<side> sides;
+		std::vector<wall> walls;
+		std::vector<thing> things;
+		std::vector<uint64_t> pvs;
+		std::vector<mover> movers;
+		std::vector<scroller> scrollers;
 	};
 
 	std::shared_ptr<tex> load_texture_from_bmp(const std::string& fileName)
@@ -141,6 +187,228 @@ namespace map
 
 		return loadedTexture;
 	}
+
+	// Magenta checkerboard drawn in place of textures that are missing or not
+	// loaded yet.
+	inline void make_placeholder_texture(tex& out)
+	{
+		constexpr int PLACEHOLDER_SIZE = 8;
+
+		out.name = "placeholder";
+		out.width = PLACEHOLDER_SIZE;
+		out.height = PLACEHOLDER_SIZE;
+		out.pitch = PLACEHOLDER_SIZE * tex::BYTES_PER_PIXEL;
+		out.data = std::make_unique<uint8_t[]>(out.pitch * out.height);
+
+		uint8_t* pixel = out.data.get();
+		for(int y = 0; y < PLACEHOLDER_SIZE; y++)
+		{
+			for(int x = 0; x < PLACEHOLDER_SIZE; x++)
+			{
+				const uint8_t c = ((x ^ y) & 1) ? 0xFF : 0x00;
+				*pixel++ = c;
+				*pixel++ = 0x00;
+				*pixel++ = c;
+				*pixel++ = 0xFF;
+			}
+		}
+	}
+
+	inline std::shared_ptr<level> load_level(const std::string& fileName)
+	{
+		constexpr char START_ERROR_MSG[] = "Error loadLevel: ";
+
+		std::ifstream file(fileName);
+
+		if(!file.is_open())
+		{
+			std::cerr << START_ERROR_MSG << "The file " << fileName << " did not open." << std::endl;
+			return std::shared_ptr<level>(nullptr);
+		}
+
+		auto loadedLevel = std::make_shared<level>();
+
+		// Entries may refer to ones further down the file, so indices are
+		// checked once everything is read. Texture and side ids may be -1.
+		enum { TEXTURES, SECTORS, SIDES };
+		struct reference
+		{
+			int lineNumber;
+			int id;
+			int target;
+			bool optional;
+		};
+		std::vector<reference> references;
+
+		std::string line;
+		int lineNumber = 0;
+		auto refer = [&references, &lineNumber](int id, int target, bool optional)
+		{
+			references.push_back(reference{lineNumber, id, target, optional});
+		};
+
+		while(std::getline(file, line))
+		{
+			lineNumber++;
+
+			std::istringstream stream(line);
+			std::string type;
+			if(!(stream >> type) || type[0] == '#')
+				continue;
+
+			bool ok = false;
+			if(type == "tex")
+			{
+				std::string texName;
+				ok = (bool)(stream >> texName);
+				loadedLevel->textures.push_back(texName);
+			}
+			else if(type == "sector")
+			{
+				sector s;
+				ok = (bool)(stream >> s.floorHeight >> s.ceilingHeight >> s.floorTex >> s.ceilingTex);
+				refer(s.floorTex, TEXTURES, true);
+				refer(s.ceilingTex, TEXTURES, true);
+				loadedLevel->sectors.push_back(s);
+			}
+			else if(type == "side")
+			{
+				side s;
+				ok = (bool)(stream >> s.topTex >> s.midTex >> s.botTex >> s.texCoord.left >>
+					s.texCoord.right >> s.texCoord.bottom >> s.texCoord.top >> s.sectorId);
+				refer(s.topTex, TEXTURES, true);
+				refer(s.midTex, TEXTURES, true);
+				refer(s.botTex, TEXTURES, true);
+				refer(s.sectorId, SECTORS, false);
+				loadedLevel->sides.push_back(s);
+			}
+			else if(type == "wall")
+			{
+				float x0, y0, x1, y1;
+				wall w;
+				ok = (bool)(stream >> x0 >> y0 >> x1 >> y1 >> w.frontId >> w.backId);
+				w.p0 = {x0, y0};
+				w.p1 = {x1, y1};
+				refer(w.frontId, SIDES, true);
+				refer(w.backId, SIDES, true);
+				loadedLevel->walls.push_back(w);
+			}
+			else if(type == "thing")
+			{
+				float x, y;
+				thing t;
+				ok = (bool)(stream >> x >> y >> t.bottom >> t.top >> t.width >> t.texId);
+				t.pos = {x, y};
+				refer(t.texId, TEXTURES, true);
+				loadedLevel->things.push_back(t);
+			}
+			else if(type == "mover")
+			{
+				std::string kindName;
+				mover m;
+				ok = (bool)(stream >> kindName >> m.sectorId >> m.low >> m.high >> m.speed >> m.wait);
+				if(kindName == "door")
+					m.type = mover::kind::DOOR;
+				else if(kindName == "lift")
+					m.type = mover::kind::LIFT;
+				else if(kindName == "crusher")
+					m.type = mover::kind::CRUSHER;
+				else
+					ok = false;
+				m.timer = 0.0f;
+				m.direction = 1;
+				refer(m.sectorId, SECTORS, false);
+				loadedLevel->movers.push_back(m);
+			}
+			else if(type == "scroller")
+			{
+				scroller sc;
+				ok = (bool)(stream >> sc.sideId >> sc.du >> sc.dv);
+				refer(sc.sideId, SIDES, false);
+				loadedLevel->scrollers.push_back(sc);
+			}
+			else if(type == "pvs")
+			{
+				uint64_t word;
+				while(stream >> std::hex >> word)
+					loadedLevel->pvs.push_back(word);
+				ok = true;
+			}
+
+			if(!ok)
+			{
+				std::cerr << START_ERROR_MSG << "The file " << fileName << " has a bad entry on line " << lineNumber << "." << std::endl;
+				return std::shared_ptr<level>(nullptr);
+			}
+		}
+
+		const size_t counts[] = {loadedLevel->textures.size(), loadedLevel->sectors.size(), loadedLevel->sides.size()};
+		for(const auto& r : references)
+		{
+			if(r.id == -1 && r.optional)
+				continue;
+			if(r.id < 0 || (size_t)r.id >= counts[r.target])
+			{
+				std::cerr << START_ERROR_MSG << "The file " << fileName << " has a bad entry on line " << r.lineNumber << "." << std::endl;
+				return std::shared_ptr<level>(nullptr);
+			}
+		}
+
+		const size_t pvsSize = loadedLevel->sectors.size() * ((loadedLevel->sectors.size() + 63) / 64);
+		if(!loadedLevel->pvs.empty() && loadedLevel->pvs.size() != pvsSize)
+		{
+			std::cerr << START_ERROR_MSG << "The file " << fileName << " has a pvs that does not match its sectors." << std::endl;
+			loadedLevel->pvs.clear();
+		}
+
+		return loadedLevel;
+	}
+
+	inline bool save_level(const level& lvl, const std::string& fileName)
+	{
+		std::ofstream file(fileName);
+
+		if(!file.is_open())
+		{
+			std::cerr << "Error saveLevel: The file " << fileName << " did not open." << std::endl;
+			return false;
+		}
+
+		// Enough digits that every float reads back to the same value.
+		file << std::setprecision(std::numeric_limits<float>::max_digits10);
+
+		for(const auto& t : lvl.textures)
+			file << "tex " << t << '\n';
+		for(const auto& s : lvl.sectors)
+			file << "sector " << s.floorHeight << ' ' << s.ceilingHeight << ' ' << s.floorTex << ' ' << s.ceilingTex << '\n';
+		for(const auto& s : lvl.sides)
+			file << "side " << s.topTex << ' ' << s.midTex << ' ' << s.botTex << ' ' << s.texCoord.left << ' ' <<
+				s.texCoord.right << ' ' << s.texCoord.bottom << ' ' << s.texCoord.top << ' ' << s.sectorId << '\n';
+		for(const auto& w : lvl.walls)
+			file << "wall " << w.p0.getX() << ' ' << w.p0.getY() << ' ' << w.p1.getX() << ' ' << w.p1.getY() << ' ' <<
+				w.frontId << ' ' << w.backId << '\n';
+		for(const auto& t : lvl.things)
+			file << "thing " << t.pos.getX() << ' ' << t.pos.getY() << ' ' << t.bottom << ' ' << t.top << ' ' <<
+				t.width << ' ' << t.texId << '\n';
+
+		constexpr const char* MOVER_NAMES[] = {"door", "lift", "crusher"};
+		for(const auto& m : lvl.movers)
+			file << "mover " << MOVER_NAMES[(int)m.type] << ' ' << m.sectorId << ' ' << m.low << ' ' << m.high << ' ' <<
+				m.speed << ' ' << m.wait << '\n';
+		for(const auto& sc : lvl.scrollers)
+			file << "scroller " << sc.sideId << ' ' << sc.du << ' ' << sc.dv << '\n';
+
+		const size_t words = (lvl.sectors.size() + 63) / 64;
+		for(size_t i = 0; i < lvl.pvs.size(); i += words)
+		{
+			file << "pvs" << std::hex;
+			for(size_t w = 0; w < words; w++)
+				file << ' ' << lvl.pvs[i + w];
+			file << std::dec << '\n';
+		}
+
+		return (bool)file;
+	}
 }
 
 #endif
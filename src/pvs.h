@@ -0,0 +1,605 @@
+#ifndef PVS_H
+#define PVS_H
+
+#include "Math/Math.h"
+#include "map.h"
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+namespace pvs
+{
+	// Walls touching each sector, packed so that sector s owns
+	// wallIds[start[s]..start[s + 1]). A wall shared by two sectors is listed
+	// under both.
+	struct sectorwalls
+	{
+		std::vector<int> start;
+		std::vector<int> wallIds;
+	};
+
+	// Things grouped by the sector they stand in, packed like sectorwalls.
+	// Things outside every sector go in the extra last bucket, which is
+	// always treated as visible.
+	struct sectorthings
+	{
+		std::vector<int> start;
+		std::vector<int> thingIds;
+	};
+
+	// A wall seen as a way from one sector into another. farNormal points
+	// into the sector on the other side. id is unique per wall and direction.
+	struct portal
+	{
+		int id;
+		int wallId;
+		int toSector;
+		Vec2f p0;
+		Vec2f p1;
+		Vec2f farNormal;
+	};
+
+	// Sectors over budget were given every sector connected to them through
+	// portals instead of an exact row. One way pairs were found from one end
+	// only and have been marked both ways.
+	struct buildstats
+	{
+		int overBudgetSectors;
+		int oneWayPairs;
+	};
+
+	inline int words_per_sector(const map::level& level)
+	{
+		return ((int)level.sectors.size() + 63) / 64;
+	}
+
+	inline bool is_visible(const map::level& level, int fromSector, int toSector)
+	{
+		const uint64_t word = level.pvs[fromSector * words_per_sector(level) + toSector / 64];
+		return (word >> (toSector % 64)) & 1;
+	}
+
+	inline void build_sector_walls(const map::level& level, sectorwalls& out)
+	{
+		const int sectorCount = (int)level.sectors.size();
+		auto forEachSector = [&level](const map::wall& w, auto f)
+		{
+			const int front = w.frontId < 0 ? -1 : level.sides[w.frontId].sectorId;
+			const int back = w.backId < 0 ? -1 : level.sides[w.backId].sectorId;
+			if(front >= 0)
+				f(front);
+			if(back >= 0 && back != front)
+				f(back);
+		};
+
+		out.start.assign(sectorCount + 1, 0);
+		for(const auto& w : level.walls)
+			forEachSector(w, [&out](int s){ out.start[s + 1]++; });
+
+		for(int s = 0; s < sectorCount; s++)
+			out.start[s + 1] += out.start[s];
+
+		out.wallIds.resize(out.start[sectorCount]);
+		std::vector<int> cursor(out.start.begin(), out.start.end() - 1);
+		for(int w = 0; w < (int)level.walls.size(); w++)
+			forEachSector(level.walls[w], [&out, &cursor, w](int s){ out.wallIds[cursor[s]++] = w; });
+	}
+
+	// Keeps the part of p0-p1 where (p - linePoint).dot(lineNormal) >= 0.
+	inline bool clip_segment(Vec2f& p0, Vec2f& p1, const Vec2f linePoint, const Vec2f lineNormal)
+	{
+		constexpr float EPSILON = 0.0001f;
+
+		const float normalLength = lineNormal.length();
+		if(normalLength <= 0.0f)
+			return true;
+
+		const float d0 = (p0 - linePoint).dot(lineNormal) / normalLength;
+		const float d1 = (p1 - linePoint).dot(lineNormal) / normalLength;
+
+		if(d0 < -EPSILON && d1 < -EPSILON)
+			return false;
+		if(d0 <= 0.0f && d1 <= 0.0f)
+		{
+			if(d0 < d1)
+				p0 = p1;
+			else
+				p1 = p0;
+		}
+		else if(d0 < 0.0f && d1 > 0.0f)
+			p0 = p0 + (p1 - p0) * (d0 / (d0 - d1));
+		else if(d1 < 0.0f && d0 > 0.0f)
+			p1 = p1 + (p0 - p1) * (d1 / (d1 - d0));
+		return true;
+	}
+
+	namespace detail
+	{
+		// The part of the source portal and of a reached portal a flow went
+		// through, as parameters along their p0 -> p1.
+		struct window
+		{
+			float sourceMin;
+			float sourceMax;
+			float passMin;
+			float passMax;
+			int depth;
+		};
+
+		struct flowstate
+		{
+			const std::vector<std::vector<portal>>& sectorPortals;
+			uint64_t* row;
+			std::vector<int> path;
+			Vec2f sourceP0;
+			Vec2f sourceDir;
+			std::vector<std::vector<window>> windows;
+			std::vector<int> touched;
+			int marked;
+			int reachable;
+			int steps;
+		};
+
+		constexpr int MAX_PORTAL_DEPTH = 64;
+		constexpr int MAX_FLOW_STEPS = 1 << 13;
+
+		inline void mark(uint64_t* row, int sector)
+		{
+			row[sector / 64] |= uint64_t(1) << (sector % 64);
+		}
+
+		inline void mark(flowstate& state, int sector)
+		{
+			const uint64_t bit = uint64_t(1) << (sector % 64);
+			if(!(state.row[sector / 64] & bit))
+			{
+				state.row[sector / 64] |= bit;
+				state.marked++;
+			}
+		}
+
+		// Nothing more can be marked once every connected sector is, and the
+		// search gives up when it runs out of steps.
+		inline bool finished(const flowstate& state)
+		{
+			return state.marked == state.reachable || state.steps >= MAX_FLOW_STEPS;
+		}
+
+		inline float param(const Vec2f p, const Vec2f p0, const Vec2f dir)
+		{
+			return (p - p0).dot(dir) / dir.dot(dir);
+		}
+
+		// Records that next was reached through n0-n1 from source0-source1.
+		// Returns false when an earlier visit at no greater depth covered both
+		// windows, since every line of this visit was then flowed already.
+		inline bool enter(flowstate& state, const portal& next, const Vec2f n0, const Vec2f n1,
+			const Vec2f source0, const Vec2f source1)
+		{
+			const float s0 = param(source0, state.sourceP0, state.sourceDir);
+			const float s1 = param(source1, state.sourceP0, state.sourceDir);
+			const float t0 = param(n0, next.p0, next.p1 - next.p0);
+			const float t1 = param(n1, next.p0, next.p1 - next.p0);
+			const window w = {std::min(s0, s1), std::max(s0, s1), std::min(t0, t1), std::max(t0, t1),
+				(int)state.path.size()};
+
+			auto covers = [](const window& a, const window& b)
+			{
+				return a.sourceMin <= b.sourceMin && a.sourceMax >= b.sourceMax &&
+					a.passMin <= b.passMin && a.passMax >= b.passMax && a.depth <= b.depth;
+			};
+
+			auto& seen = state.windows[next.id];
+			for(const auto& old : seen)
+				if(covers(old, w))
+					return false;
+
+			if(seen.empty())
+				state.touched.push_back(next.id);
+			seen.erase(std::remove_if(seen.begin(), seen.end(),
+				[&covers, &w](const window& old){ return covers(w, old); }), seen.end());
+			seen.push_back(w);
+			return true;
+		}
+
+		// Clips n0-n1 to what a straight line through both the source and the
+		// pass segment can reach. The region is bounded by the separating
+		// lines, those through one endpoint of each segment that have the two
+		// segments on opposite sides. Lines through both endpoints of a
+		// degenerate segment bound it by the other segment alone.
+		inline bool clip_to_separators(Vec2f& n0, Vec2f& n1, const Vec2f (&source)[2], const Vec2f (&pass)[2])
+		{
+			constexpr float EPSILON = 0.0001f;
+
+			for(int i = 0; i < 2; i++)
+			{
+				for(int j = 0; j < 2; j++)
+				{
+					const Vec2f normal = Vec2f(pass[j] - source[i]).rotate(HALF_PI);
+					const float normalLength = normal.length();
+					if(normalLength <= 0.0f)
+						continue;
+
+					const float sourceSide = (source[1 - i] - source[i]).dot(normal) / normalLength;
+					const float passSide = (pass[1 - j] - source[i]).dot(normal) / normalLength;
+
+					float keep;
+					if(passSide > EPSILON)
+					{
+						if(sourceSide > EPSILON)
+							continue;
+						keep = 1.0f;
+					}
+					else if(passSide < -EPSILON)
+					{
+						if(sourceSide < -EPSILON)
+							continue;
+						keep = -1.0f;
+					}
+					else if(sourceSide > EPSILON)
+						keep = -1.0f;
+					else if(sourceSide < -EPSILON)
+						keep = 1.0f;
+					else
+						continue;
+
+					if(!clip_segment(n0, n1, source[i], normal * keep))
+						return false;
+				}
+			}
+			return true;
+		}
+
+		// Everything reachable in sector by a straight line that passes
+		// through both the source and the pass portal.
+		inline void flow(flowstate& state, Vec2f s0, Vec2f s1, Vec2f pass0, Vec2f pass1,
+			const Vec2f passNormal, int sector)
+		{
+			if((int)state.path.size() >= MAX_PORTAL_DEPTH || finished(state))
+				return;
+			state.steps++;
+
+			const Vec2f source[2] = {s0, s1};
+			const Vec2f pass[2] = {pass0, pass1};
+
+			for(const auto& next : state.sectorPortals[sector])
+			{
+				if(std::find(state.path.begin(), state.path.end(), next.wallId) != state.path.end())
+					continue;
+
+				Vec2f n0 = next.p0;
+				Vec2f n1 = next.p1;
+				if(!clip_segment(n0, n1, pass0, passNormal))
+					continue;
+				if(!clip_to_separators(n0, n1, source, pass))
+					continue;
+
+				mark(state, next.toSector);
+
+				Vec2f source0 = s0;
+				Vec2f source1 = s1;
+				const Vec2f window[2] = {n0, n1};
+				if(!clip_segment(source0, source1, n0, -next.farNormal))
+					continue;
+				if(!clip_to_separators(source0, source1, window, pass))
+					continue;
+				if(!enter(state, next, n0, n1, source0, source1))
+					continue;
+
+				state.path.push_back(next.wallId);
+				flow(state, source0, source1, n0, n1, next.farNormal, next.toSector);
+				state.path.pop_back();
+
+				if(finished(state))
+					return;
+			}
+		}
+	}
+
+	// Computes, for every sector, which sectors can be seen through any chain
+	// of portals. A wall is a portal when its two sides belong to different
+	// sectors. The front side faces the sector to the left of p0 -> p1.
+	// A sector whose search runs out of steps falls back to every sector
+	// connected to it, which over-estimates but never misses one.
+	inline buildstats build_pvs(map::level& level)
+	{
+		const int sectorCount = (int)level.sectors.size();
+		const int words = words_per_sector(level);
+
+		std::vector<std::vector<portal>> sectorPortals(sectorCount);
+		int portalCount = 0;
+		for(int w = 0; w < (int)level.walls.size(); w++)
+		{
+			const auto& wall = level.walls[w];
+			if(wall.frontId < 0 || wall.backId < 0)
+				continue;
+
+			const int front = level.sides[wall.frontId].sectorId;
+			const int back = level.sides[wall.backId].sectorId;
+			if(front == back)
+				continue;
+
+			const Vec2f toBack = Vec2f(wall.p1 - wall.p0).rotate(-HALF_PI);
+			sectorPortals[front].push_back(portal{portalCount++, w, back, wall.p0, wall.p1, toBack});
+			sectorPortals[back].push_back(portal{portalCount++, w, front, wall.p0, wall.p1, -toBack});
+		}
+
+		// Sectors connected through portals share a component. Nothing outside
+		// a sector's component can be visible from it.
+		std::vector<int> component(sectorCount, -1);
+		std::vector<int> componentSize;
+		std::vector<int> queue;
+		for(int s = 0; s < sectorCount; s++)
+		{
+			if(component[s] >= 0)
+				continue;
+
+			const int c = (int)componentSize.size();
+			component[s] = c;
+			queue.assign(1, s);
+			for(size_t i = 0; i < queue.size(); i++)
+			{
+				for(const auto& p : sectorPortals[queue[i]])
+				{
+					if(component[p.toSector] < 0)
+					{
+						component[p.toSector] = c;
+						queue.push_back(p.toSector);
+					}
+				}
+			}
+			componentSize.push_back((int)queue.size());
+		}
+
+		level.pvs.assign((size_t)sectorCount * words, 0);
+
+		buildstats stats = {0, 0};
+		detail::flowstate state{sectorPortals, nullptr, {}, {}, {}, std::vector<std::vector<detail::window>>(portalCount), {}, 0, 0, 0};
+
+		for(int s = 0; s < sectorCount; s++)
+		{
+			state.row = level.pvs.data() + (size_t)s * words;
+			state.marked = 0;
+			state.reachable = componentSize[component[s]];
+			state.steps = 0;
+			detail::mark(state, s);
+
+			for(const auto& source : sectorPortals[s])
+			{
+				detail::mark(state, source.toSector);
+				state.path.push_back(source.wallId);
+				state.sourceP0 = source.p0;
+				state.sourceDir = source.p1 - source.p0;
+
+				for(const auto& next : sectorPortals[source.toSector])
+				{
+					if(next.wallId == source.wallId || detail::finished(state))
+						continue;
+
+					Vec2f n0 = next.p0;
+					Vec2f n1 = next.p1;
+					if(!clip_segment(n0, n1, source.p0, source.farNormal))
+						continue;
+
+					detail::mark(state, next.toSector);
+					if(!detail::enter(state, next, n0, n1, source.p0, source.p1))
+						continue;
+
+					state.path.push_back(next.wallId);
+					detail::flow(state, source.p0, source.p1, n0, n1, next.farNormal, next.toSector);
+					state.path.pop_back();
+				}
+
+				state.path.pop_back();
+				for(int id : state.touched)
+					state.windows[id].clear();
+				state.touched.clear();
+			}
+
+			if(state.steps >= detail::MAX_FLOW_STEPS)
+			{
+				stats.overBudgetSectors++;
+				for(int t = 0; t < sectorCount; t++)
+					if(component[t] == component[s])
+						detail::mark(state.row, t);
+			}
+		}
+
+		// Sight lines run both ways, so a pair found from one end only is
+		// marked from the other as well.
+		for(int s = 0; s < sectorCount; s++)
+		{
+			for(int t = s + 1; t < sectorCount; t++)
+			{
+				if(is_visible(level, s, t) != is_visible(level, t, s))
+				{
+					detail::mark(level.pvs.data() + (size_t)s * words, t);
+					detail::mark(level.pvs.data() + (size_t)t * words, s);
+					stats.oneWayPairs++;
+				}
+			}
+		}
+
+		return stats;
+	}
+
+	inline bool point_in_sector(const map::level& level, const sectorwalls& walls, int sector, Vec2f pos)
+	{
+		bool inside = false;
+		for(int i = walls.start[sector]; i < walls.start[sector + 1]; i++)
+		{
+			const auto& w = level.walls[walls.wallIds[i]];
+			if(w.frontId >= 0 && w.backId >= 0 &&
+				level.sides[w.frontId].sectorId == level.sides[w.backId].sectorId)
+				continue;
+
+			const Vec2f& a = w.p0;
+			const Vec2f& b = w.p1;
+			if((a.getY() > pos.getY()) != (b.getY() > pos.getY()))
+			{
+				const float x = a.getX() + (pos.getY() - a.getY()) * (b.getX() - a.getX()) / (b.getY() - a.getY());
+				if(pos.getX() < x)
+					inside = !inside;
+			}
+		}
+		return inside;
+	}
+
+	// Finds the sector containing pos. The hint sector and its neighbours are
+	// tried first since the player rarely moves further than that in a frame.
+	inline int locate_sector(const map::level& level, const sectorwalls& walls, Vec2f pos, int hint)
+	{
+		if(hint >= 0)
+		{
+			if(point_in_sector(level, walls, hint, pos))
+				return hint;
+
+			for(int i = walls.start[hint]; i < walls.start[hint + 1]; i++)
+			{
+				const auto& w = level.walls[walls.wallIds[i]];
+				if(w.frontId < 0 || w.backId < 0)
+					continue;
+				const int front = level.sides[w.frontId].sectorId;
+				const int other = front == hint ? level.sides[w.backId].sectorId : front;
+				if(other != hint && point_in_sector(level, walls, other, pos))
+					return other;
+			}
+		}
+
+		for(int s = 0; s < (int)level.sectors.size(); s++)
+			if(s != hint && point_in_sector(level, walls, s, pos))
+				return s;
+
+		return -1;
+	}
+
+	// Calls f(s) for every sector s in the pvs row of sector.
+	template<typename F>
+	void for_each_visible_sector(const map::level& level, int sector, F f)
+	{
+		const int words = words_per_sector(level);
+		const uint64_t* row = level.pvs.data() + (size_t)sector * words;
+
+		for(int word = 0; word < words; word++)
+		{
+			uint64_t bits = row[word];
+			while(bits)
+			{
+				f(word * 64 + __builtin_ctzll(bits));
+				bits &= bits - 1;
+			}
+		}
+	}
+
+	// Upper bound on how many walls gather_visible_walls copies for sector.
+	inline size_t max_visible_walls(const map::level& level, const sectorwalls& walls, int sector)
+	{
+		if(sector < 0 || level.pvs.empty())
+			return level.walls.size();
+
+		size_t count = 0;
+		for_each_visible_sector(level, sector, [&walls, &count](int s)
+		{
+			count += walls.start[s + 1] - walls.start[s];
+		});
+		return count;
+	}
+
+	// Copies the walls of every sector visible from sector. Walls between two
+	// visible sectors are only copied once. Without a sector every wall is
+	// copied.
+	template<typename WallIt>
+	void gather_visible_walls(const map::level& level, const sectorwalls& walls, int sector,
+		WallIt outBeg, WallIt& outEnd)
+	{
+		if(sector < 0 || level.pvs.empty())
+		{
+			outEnd = std::copy(level.walls.begin(), level.walls.end(), outBeg);
+			return;
+		}
+
+		for_each_visible_sector(level, sector, [&](int s)
+		{
+			for(int i = walls.start[s]; i < walls.start[s + 1]; i++)
+			{
+				const auto& w = level.walls[walls.wallIds[i]];
+				const int front = w.frontId < 0 ? -1 : level.sides[w.frontId].sectorId;
+				if(front != s && front >= 0 && is_visible(level, sector, front))
+					continue;
+
+				*outBeg = w;
+				++outBeg;
+			}
+		});
+		outEnd = outBeg;
+	}
+
+	inline void build_sector_things(const map::level& level, const sectorwalls& walls, sectorthings& out)
+	{
+		const int sectorCount = (int)level.sectors.size();
+
+		std::vector<int> thingSectors(level.things.size());
+		int hint = -1;
+		for(size_t t = 0; t < level.things.size(); t++)
+		{
+			const int s = locate_sector(level, walls, level.things[t].pos, hint);
+			thingSectors[t] = s < 0 ? sectorCount : s;
+			hint = s;
+		}
+
+		out.start.assign(sectorCount + 2, 0);
+		for(int s : thingSectors)
+			out.start[s + 1]++;
+
+		for(int s = 0; s <= sectorCount; s++)
+			out.start[s + 1] += out.start[s];
+
+		out.thingIds.resize(level.things.size());
+		std::vector<int> cursor(out.start.begin(), out.start.end() - 1);
+		for(size_t t = 0; t < thingSectors.size(); t++)
+			out.thingIds[cursor[thingSectors[t]]++] = (int)t;
+	}
+
+	// Upper bound on how many things gather_visible_things copies for sector.
+	inline size_t max_visible_things(const map::level& level, const sectorthings& things, int sector)
+	{
+		if(sector < 0 || level.pvs.empty())
+			return level.things.size();
+
+		const int outside = (int)level.sectors.size();
+		size_t count = things.start[outside + 1] - things.start[outside];
+		for_each_visible_sector(level, sector, [&things, &count](int s)
+		{
+			count += things.start[s + 1] - things.start[s];
+		});
+		return count;
+	}
+
+	// Copies the things standing in a sector visible from sector, and those
+	// outside every sector. Without a sector every thing is copied.
+	template<typename ThingIt>
+	void gather_visible_things(const map::level& level, const sectorthings& things, int sector,
+		ThingIt outBeg, ThingIt& outEnd)
+	{
+		if(sector < 0 || level.pvs.empty())
+		{
+			outEnd = std::copy(level.things.begin(), level.things.end(), outBeg);
+			return;
+		}
+
+		auto copyBucket = [&](int s)
+		{
+			for(int i = things.start[s]; i < things.start[s + 1]; i++)
+			{
+				*outBeg = level.things[things.thingIds[i]];
+				++outBeg;
+			}
+		};
+
+		for_each_visible_sector(level, sector, copyBucket);
+		copyBucket((int)level.sectors.size());
+		outEnd = outBeg;
+	}
+}
+
+#endif
@@ -3,13 +3,16 @@
 
 #include "Math/Math.h"
 #include "map.h"
+#include "kernels.h"
 #include <cstdint>
 #include <memory>
+#include <algorithm>
 
 namespace render
 {
 	static int buffer_width;
 	static int buffer_height;
+	static columnkernel wall_column_kernel = select_column_kernel(false);
 
 	struct screencoord
 	{
@@ -32,9 +35,9 @@ namespace render
 		float texClipRight;
 	};
 
-	template<typename WallIt>
+	template<typename WallIt, typename TranslatedWallIt>
 	void translate_walls(const Vec2f playerPos, const float angle, WallIt inBeg,
-			const WallIt inEnd, WallIt outBeg, WallIt& outEnd)
+			const WallIt inEnd, TranslatedWallIt outBeg, TranslatedWallIt& outEnd)
 	{
 		while(inBeg != inEnd)
 		{
@@ -176,19 +179,21 @@ namespace render
 		outEnd = outBeg;
 	}
 
-	template<typename ScreenCoordsIt, typename SideIt>
+	template<typename ScreenCoordsIt, typename SideIt, typename TexSource>
 	void output_to_screen_buffer(ScreenCoordsIt inBeg, const ScreenCoordsIt inEnd, SideIt sideArr,
-		int screenWidth, int screenHeight, int bufferPitch, uint8_t* buffer)
+		TexSource& textures, int screenWidth, int screenHeight, int bufferPitch, uint8_t* buffer,
+		float* columnDepth)
 	{
-		auto drawVerticalWallColumn = [screenWidth, screenHeight, bufferPitch, buffer]
-			(int yMin, int yMax, int x, int u, float topTex, float bottomTex,
-			const std::shared_ptr<map::tex>& tex)
+		const int destPitch = bufferPitch / 4;
+
+		auto drawVerticalWallColumn = [screenWidth, screenHeight, bufferPitch, destPitch, buffer]
+			(int yMin, int yMax, int x, float u, float topTex, float bottomTex,
+			const map::tex& tex)
 		{
 			if(x < 0 || x >= screenWidth) return;
 
-			const int yDiff = yMax - yMin;
-			const int& texWidth = tex->width;
-			const int& texHeight = tex->height;
+			const int yDiff = (yMax - yMin == 0) ? 1 : yMax - yMin;
+			const int& texHeight = tex.height;
 			float v = bottomTex * texHeight;
 			const float vMax = topTex * texHeight;
 			const float vStep = (vMax - v) / yDiff;
@@ -200,20 +205,11 @@ namespace render
 			}
 			if(yMax >= screenHeight)
 				yMax = screenHeight - 1;
+			if(yMax < yMin)
+				return;
 
-			uint8_t* srcPixStart = nullptr;
-			uint8_t* destPixStart = nullptr;
-			for(int y = yMin; y <= yMax; y++)
-			{
-				srcPixStart = tex->data.get() + (u + (((int)v  % texHeight) * texWidth)) * 4;
-				//srcPixStart = tex->data.get() + ((int)v + ((u % texWidth) * texHeight)) * 4;
-				destPixStart = buffer + (x + y * screenWidth) * 4;
-				*destPixStart++ = *srcPixStart++;
-				*destPixStart++ = *srcPixStart++;
-				*destPixStart++ = *srcPixStart++;
-				*destPixStart++ = *srcPixStart++;
-				v += vStep;
-			}
+			uint32_t* dest = (uint32_t*)(buffer + yMin * bufferPitch) + x;
+			wall_column_kernel(dest, destPitch, yMax - yMin + 1, tex, u, v, vStep);
 		};
 
 		while(inBeg != inEnd)
@@ -238,14 +234,17 @@ namespace render
 			const float oneOverZRight = 1.0f / coords.zDistRight;
 			const float oneOverZStep = (oneOverZRight - oneOverZLeft) / xDiff;
 
-			const int& texWidth = side.midTex->width;
+			const map::tex& midTex = textures.get(side.midTex);
+			const int& texWidth = midTex.width;
 			float texLeft = (texCoord.left * texWidth) / coords.zDistLeft;
 			const float texRight = (texCoord.right * texWidth) / coords.zDistRight;
 			const float texStep = (texRight - texLeft) / xDiff;
 
 			for(int x = coords.leftX; x <= coords.rightX; x++)
 			{
-				drawVerticalWallColumn((int)yTop, (int)yBottom, x, (int)(texLeft / oneOverZLeft) % texWidth, texCoord.top, texCoord.bottom, side.midTex);
+				if(x >= 0 && x < screenWidth)
+					columnDepth[x] = std::min(columnDepth[x], 1.0f / oneOverZLeft);
+				drawVerticalWallColumn((int)yTop, (int)yBottom, x, texLeft / oneOverZLeft, texCoord.top, texCoord.bottom, midTex);
 				yTop += yTopStep;
 				yBottom += yBottomStep;
 
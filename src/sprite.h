@@ -0,0 +1,170 @@
+#ifndef SPRITE_H
+#define SPRITE_H
+
+#include "render.h"
+#include "map.h"
+#include "arena.h"
+#include <cstdint>
+#include <algorithm>
+
+namespace render
+{
+	struct spritecoord
+	{
+		int leftX, rightX;
+		int topY, bottomY;
+		float z;
+		int texId;
+	};
+
+	// Sprites grouped by the screen column ranges they cover. Each bin lists
+	// sprite indices from far to near.
+	struct spritebins
+	{
+		static constexpr int BIN_WIDTH = 32;
+		arena::span<int> binStart;
+		arena::span<int> spriteIds;
+	};
+
+	template<typename ThingIt, typename TranslatedThingIt>
+	void translate_things(const Vec2f playerPos, const float angle, ThingIt inBeg,
+			const ThingIt inEnd, TranslatedThingIt outBeg, TranslatedThingIt& outEnd)
+	{
+		const float c = std::cos(-angle);
+		const float s = std::sin(-angle);
+
+		while(inBeg != inEnd)
+		{
+			*outBeg = *inBeg;
+			const Vec2f p = inBeg->pos - playerPos;
+			outBeg->pos = {c * p.getX() - s * p.getY(), s * p.getX() + c * p.getY()};
+
+			++inBeg;
+			++outBeg;
+		}
+		outEnd = outBeg;
+	}
+
+	template<typename ThingIt, typename SpriteCoordIt>
+	void gen_sprite_coords(ThingIt inBeg, const ThingIt inEnd, SpriteCoordIt outBeg, SpriteCoordIt& outEnd)
+	{
+		static const float fov = (90.0f * PI) / 180.0f;
+		static const float tanHalfFov = std::tan(fov / 2.0f);
+		static constexpr float nearZ = 0.05f;
+
+		while(inBeg != inEnd)
+		{
+			const auto& t = *inBeg;
+			++inBeg;
+
+			const float z = t.pos.getX();
+			const float halfWidth = t.width / 2.0f;
+
+			if(z < nearZ)
+				continue;
+			if(t.pos.getY() - halfWidth > z * tanHalfFov || t.pos.getY() + halfWidth < -z * tanHalfFov)
+				continue;
+
+			const float xScale = (buffer_width / 2) / (z * tanHalfFov);
+			const float yScale = (0.2f * buffer_height) / z;
+
+			auto& sprite = *outBeg;
+			sprite.leftX = (int)((t.pos.getY() - halfWidth) * xScale + (buffer_width / 2));
+			sprite.rightX = (int)((t.pos.getY() + halfWidth) * xScale + (buffer_width / 2));
+			sprite.topY = -(int)(yScale * t.top) + (buffer_height / 2);
+			sprite.bottomY = (int)(yScale * -t.bottom) + (buffer_height / 2);
+			sprite.z = z;
+			sprite.texId = t.texId;
+
+			if(sprite.rightX < 0 || sprite.leftX >= buffer_width || sprite.bottomY <= sprite.topY)
+				continue;
+
+			++outBeg;
+		}
+		outEnd = outBeg;
+	}
+
+	// Sorts the sprites far to near and distributes them over the column bins.
+	// The bins live in the frame arena.
+	template<typename SpriteCoordIt>
+	void bin_sprites(SpriteCoordIt inBeg, const SpriteCoordIt inEnd, int screenWidth,
+		arena::framearena& frameArena, spritebins& bins)
+	{
+		std::sort(inBeg, inEnd, [](const spritecoord& a, const spritecoord& b){ return a.z > b.z; });
+
+		const int binCount = (screenWidth + spritebins::BIN_WIDTH - 1) / spritebins::BIN_WIDTH;
+		auto firstBin = [](const spritecoord& s){ return std::max(s.leftX, 0) / spritebins::BIN_WIDTH; };
+		auto lastBin = [binCount](const spritecoord& s){ return std::min(s.rightX / spritebins::BIN_WIDTH, binCount - 1); };
+
+		bins.binStart = frameArena.alloc<int>(binCount + 1);
+		std::fill(bins.binStart.begin(), bins.binStart.end(), 0);
+		for(auto it = inBeg; it != inEnd; ++it)
+			for(int b = firstBin(*it); b <= lastBin(*it); b++)
+				bins.binStart[b + 1]++;
+
+		for(int b = 0; b < binCount; b++)
+			bins.binStart[b + 1] += bins.binStart[b];
+
+		bins.spriteIds = frameArena.alloc<int>(bins.binStart[binCount]);
+		auto cursor = frameArena.alloc<int>(binCount);
+		std::copy(bins.binStart.begin(), bins.binStart.end() - 1, cursor.begin());
+
+		int id = 0;
+		for(auto it = inBeg; it != inEnd; ++it, ++id)
+			for(int b = firstBin(*it); b <= lastBin(*it); b++)
+				bins.spriteIds[cursor[b]++] = id;
+	}
+
+	template<typename SpriteCoordIt, typename TexSource>
+	void output_sprites_to_screen_buffer(SpriteCoordIt spriteArr, const spritebins& bins, TexSource& textures,
+		const float* columnDepth, int screenWidth, int screenHeight, int bufferPitch, uint8_t* buffer)
+	{
+		const int binCount = (int)bins.binStart.size - 1;
+		const int destPitch = bufferPitch / 4;
+
+		for(int b = 0; b < binCount; b++)
+		{
+			const int binLeft = b * spritebins::BIN_WIDTH;
+			const int binRight = std::min(binLeft + spritebins::BIN_WIDTH, screenWidth) - 1;
+
+			for(int i = bins.binStart[b]; i < bins.binStart[b + 1]; i++)
+			{
+				const spritecoord& sprite = spriteArr[bins.spriteIds[i]];
+				const map::tex& tex = textures.get(sprite.texId);
+				const int texPitch = tex.pitch / map::tex::BYTES_PER_PIXEL;
+
+				const int spriteWidth = std::max(sprite.rightX - sprite.leftX, 1);
+				const int spriteHeight = std::max(sprite.bottomY - sprite.topY, 1);
+				const float uStep = (float)tex.width / spriteWidth;
+				const float vStep = (float)tex.height / spriteHeight;
+
+				const int xMin = std::max(sprite.leftX, binLeft);
+				const int xMax = std::min(sprite.rightX, binRight);
+				const int yMin = std::max(sprite.topY, 0);
+				const int yMax = std::min(sprite.bottomY, screenHeight - 1);
+
+				for(int x = xMin; x <= xMax; x++)
+				{
+					if(sprite.z >= columnDepth[x])
+						continue;
+
+					const int u = std::min((int)((x - sprite.leftX) * uStep), tex.width - 1);
+					float v = (yMin - sprite.topY) * vStep;
+
+					const uint32_t* srcColumn = (const uint32_t*)tex.data.get() + u;
+					uint32_t* destPix = (uint32_t*)(buffer + yMin * bufferPitch) + x;
+					for(int y = yMin; y <= yMax; y++)
+					{
+						const uint32_t srcPix = srcColumn[std::min((int)v, tex.height - 1) * texPitch];
+						if(srcPix & 0xFF000000)
+							*destPix = srcPix;
+						destPix += destPitch;
+						v += vStep;
+					}
+				}
+			}
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef TEXCACHE_H
+#define TEXCACHE_H
+
+#include "map.h"
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace map
+{
+	// Textures are registered up front but only loaded the first time they are
+	// drawn. Loading happens on a background thread and a placeholder is handed
+	// out until the texture is ready. All other members are render thread only.
+	class texcache
+	{
+	public:
+		explicit texcache(size_t byteBudget);
+		~texcache();
+
+		texcache(const texcache&) = delete;
+		texcache& operator=(const texcache&) = delete;
+
+		int add(const std::string& fileName);
+
+		void beginFrame();
+		const tex& get(int id);
+
+		size_t getResidentBytes() const;
+		size_t getByteBudget() const;
+	private:
+		enum class state { UNLOADED, LOADING, RESIDENT, FAILED };
+
+		struct slot
+		{
+			std::string fileName;
+			std::shared_ptr<tex> texture;
+			state status;
+			uint64_t lastUsedFrame;
+		};
+
+		struct request
+		{
+			int id;
+			std::string fileName;
+		};
+
+		struct result
+		{
+			int id;
+			std::shared_ptr<tex> texture;
+		};
+
+		void loaderLoop();
+		void evict();
+
+		static size_t textureBytes(const tex& texture);
+
+		std::vector<slot> slots;
+		tex placeholder;
+		size_t byteBudget;
+		size_t residentBytes;
+		uint64_t frame;
+
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::deque<request> requests;
+		std::vector<result> results;
+		bool quit;
+
+		std::thread loader;
+	};
+
+	inline texcache::texcache(size_t byteBudget) :
+		byteBudget(byteBudget), residentBytes(0), frame(0), quit(false)
+	{
+		make_placeholder_texture(placeholder);
+
+		loader = std::thread(&texcache::loaderLoop, this);
+	}
+
+	inline texcache::~texcache()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_one();
+		loader.join();
+	}
+
+	inline int texcache::add(const std::string& fileName)
+	{
+		slots.push_back(slot{fileName, nullptr, state::UNLOADED, 0});
+		return (int)slots.size() - 1;
+	}
+
+	inline void texcache::beginFrame()
+	{
+		frame++;
+
+		std::vector<result> done;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done.swap(results);
+		}
+
+		for(auto& r : done)
+		{
+			auto& s = slots[r.id];
+			if(!r.texture)
+			{
+				s.status = state::FAILED;
+				continue;
+			}
+			s.texture = std::move(r.texture);
+			s.status = state::RESIDENT;
+			residentBytes += textureBytes(*s.texture);
+		}
+
+		evict();
+	}
+
+	inline const tex& texcache::get(int id)
+	{
+		if(id < 0 || id >= (int)slots.size())
+			return placeholder;
+
+		auto& s = slots[id];
+		s.lastUsedFrame = frame;
+
+		if(s.status == state::RESIDENT)
+			return *s.texture;
+
+		if(s.status == state::UNLOADED)
+		{
+			s.status = state::LOADING;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				requests.push_back(request{id, s.fileName});
+			}
+			wake.notify_one();
+		}
+
+		return placeholder;
+	}
+
+	inline size_t texcache::getResidentBytes() const
+	{
+		return residentBytes;
+	}
+
+	inline size_t texcache::getByteBudget() const
+	{
+		return byteBudget;
+	}
+
+	inline void texcache::loaderLoop()
+	{
+		while(true)
+		{
+			request r;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this]{ return quit || !requests.empty(); });
+				if(quit)
+					return;
+				r = std::move(requests.front());
+				requests.pop_front();
+			}
+
+			auto texture = load_texture_from_bmp(r.fileName);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			results.push_back(result{r.id, std::move(texture)});
+		}
+	}
+
+	// Textures drawn in the previous frame are never evicted, so the budget is
+	// only exceeded when the visible working set alone is larger than it.
+	inline void texcache::evict()
+	{
+		while(residentBytes > byteBudget)
+		{
+			slot* oldest = nullptr;
+			for(auto& s : slots)
+			{
+				if(s.status != state::RESIDENT || s.lastUsedFrame + 1 >= frame)
+					continue;
+				if(!oldest || s.lastUsedFrame < oldest->lastUsedFrame)
+					oldest = &s;
+			}
+
+			if(!oldest)
+				return;
+
+			residentBytes -= textureBytes(*oldest->texture);
+			oldest->texture.reset();
+			oldest->status = state::UNLOADED;
+		}
+	}
+
+	inline size_t texcache::textureBytes(const tex& texture)
+	{
+		return (size_t)texture.pitch * texture.height;
+	}
+}
+
+#endif